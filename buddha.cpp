@@ -56,8 +56,22 @@
 Buddha::Buddha( QObject *parent ) : QThread( parent ) {
 	// Because
 	size = w = h = lowr = lowg = lowb = highr = highg = highb = 0;
-	cre = cim = scale = 0.0;
-	raw = NULL;
+	twoPass = false;
+	precision = DOUBLE_PRECISION;
+	formula = MANDELBROT_FORMULA;
+	bounded = false;
+	periodicity = DOUBLING_PERIODICITY;
+	tries = 1;
+	chains = 1;
+	sampling = METROPOLIS_SAMPLING;
+	boundaryGuided = true;
+	runSeed = 123456789;
+	runStream = 0;
+	reproducible = false;
+	periodicityStep = STEP;
+	periodicityTolerance = FLT_EPSILON * FLT_EPSILON;
+	cre = cim = creLo = cimLo = scale = 0.0;
+	histogramStrategy = ATOMIC_HISTOGRAM;
 	RGBImage = NULL;
 	threads = 0;
 	generatorsStatus = STOP;
@@ -74,6 +88,15 @@ Buddha::Buddha( QObject *parent ) : QThread( parent ) {
 
 void Buddha::run ( ) {
 	qDebug() << "Buddha::run(), is thread " << QThread::currentThreadId();
+
+	// the interior map is done here, before the events are processed, so it's
+	// ready when the generators start. It's computed only the first time.
+	if ( !interior.load( INTERIOR_CACHE ) ) {
+		qDebug() << "Buddha::run(), building the interior map";
+		interior.build( );
+		if ( !interior.save( INTERIOR_CACHE ) ) qDebug() << "Buddha::run(), cannot save" << INTERIOR_CACHE;
+	}
+
 	exec();	// To start an event loop, exec() must be called inside run(). Thread affinity can be changed using moveToThread().
 	stopGenerators( );
 }
@@ -92,54 +115,36 @@ void Buddha::setContrast ( int contrast ) {
 
 
 
+// the histogram is in tiles, here it becomes rows
 void Buddha::createImage ( ) {
 	unsigned char r, g, b;
-	unsigned int j = 0;
-	for ( unsigned int i = 0; i < size; ++i, j += 3 ) {
-		r = min( powf( raw[j + 0], realContrast ) * rmul, 255.0f );
-		g = min( powf( raw[j + 1], realContrast ) * gmul, 255.0f );
-		b = min( powf( raw[j + 2], realContrast ) * bmul, 255.0f );
-
-		RGBImage[i] = r << 16 | g << 8 | b;
+	for ( unsigned int y = 0, i = 0; y < h; ++y ) {
+		for ( unsigned int x = 0; x < w; ++x, ++i ) {
+			const unsigned int j = histogram.index( x, y );
+			r = min( powf( histogram.value( j, 0 ), realContrast ) * rmul, 255.0f );
+			g = min( powf( histogram.value( j, 1 ), realContrast ) * gmul, 255.0f );
+			b = min( powf( histogram.value( j, 2 ), realContrast ) * bmul, 255.0f );
+
+			RGBImage[i] = r << 16 | g << 8 | b;
+		}
 	}
 }
 
 
-// this function takes the raw data from generator i and sums it
-// to the local raw array.
-void Buddha::reduceStep ( int i, bool checkValues ) {
-	unsigned int j;
-	if ( checkValues ) maxr = maxg = maxb = 0;
-
-	QMutexLocker( &generators[i]->mutex );
-	for ( j = 0; j < 3 * size; j += 3 ) {
-		raw[j+0] += generators[i]->raw[j+0];
-		raw[j+1] += generators[i]->raw[j+1];
-		raw[j+2] += generators[i]->raw[j+2];
-
-		if ( checkValues ) {
-			if ( raw[j+0] > maxr ) maxr = raw[j+0];
-			if ( raw[j+1] > maxg ) maxg = raw[j+1];
-			if ( raw[j+2] > maxb ) maxb = raw[j+2];
-		}
-	}
+// the generators write directly in the histogram, so there is nothing to sum: I only
+// look for the maximum of every channel, while they are running. The counts still in
+// their tile caches will be seen in the next frames.
+void Buddha::findMaximum ( ) {
+	maxr = histogram.maximum( 0 );
+	maxg = histogram.maximum( 1 );
+	maxb = histogram.maximum( 2 );
 
-	if ( checkValues ) {
-		rmul = maxr > 0 ? log( scale ) / (float) powf( maxr, realContrast ) * 150.0 * realLightness : 0.0;
-		gmul = maxg > 0 ? log( scale ) / (float) powf( maxg, realContrast ) * 150.0 * realLightness : 0.0;
-		bmul = maxb > 0 ? log( scale ) / (float) powf( maxb, realContrast ) * 150.0 * realLightness : 0.0;
-	}
-}
+	rmul = maxr > 0 ? log( scale ) / (float) powf( maxr, realContrast ) * 150.0 * realLightness : 0.0;
+	gmul = maxg > 0 ? log( scale ) / (float) powf( maxg, realContrast ) * 150.0 * realLightness : 0.0;
+	bmul = maxb > 0 ? log( scale ) / (float) powf( maxb, realContrast ) * 150.0 * realLightness : 0.0;
 
-
-// Performs the whole reduce part. In the last step I also compute the
-// max calculation on the raw array.
-// TODO. This could be done in logarithmic time using cooperation between
-// generators, for the moment I keep this version for simplicity.
-void Buddha::reduce ( ) {
-	memset( raw, 0, 3 * size * sizeof( int ) );
-	for ( int i = 0; i < threads; ++i )
-		reduceStep( i, i == (threads - 1) );
+	if ( histogram.spill.lost.load( ) > 0 )
+		qDebug() << "Buddha::findMaximum(), the spill table is full," << histogram.spill.lost.load( ) << "counts lost";
 }
 
 
@@ -147,8 +152,8 @@ void Buddha::updateRGBImage( ) {
 	QTime time;
 	time.start();
 
-	reduce();
-	printf( "Time taken by the reduce steps: %d ms. ", time.elapsed() );
+	findMaximum( );
+	printf( "Time taken by the maximum: %d ms. ", time.elapsed() );
 	time.start();
 	mutex.lock();
 	createImage( );
@@ -165,22 +170,27 @@ void Buddha::saveScreenshot ( QString fileName ) {
 	cout << "Compressed size vs Full: " << compress.size() << " " << w * h * sizeof(int) << endl;
 }
 
-void Buddha::set( double re, double im, double s, uint lr, uint lg, uint lb, uint hr, uint hg, uint hb, QSize wsize, bool pause ) {
+void Buddha::set( double re, double im, double reLo, double imLo, double s, uint lr, uint lg, uint lb, uint hr, uint hg, uint hb, QSize wsize, bool pause ) {
 	qDebug() << "Buddha::set()";
-	bool haveToClear = (wsize.width() != (int) w) || (wsize.height() != (int) h) ||(re != cre) || (im != cim) || (s != scale);
+	bool resized = (wsize.width() != (int) w) || (wsize.height() != (int) h);
+	bool haveToClear = resized || (re != cre) || (im != cim) ||
+			   (reLo != creLo) || (imLo != cimLo) || (s != scale);
 	
 	if ( pause ) pauseGenerators( );
 	
 	w = wsize.width();
 	h = wsize.height();
-	// I reallocate only if the dimensions are changed otherwise I simply clean the memory
-	if ( size != w * h ) {
+	// I reallocate only if the dimensions are changed otherwise I simply clean the memory.
+	// The tiles of the histogram depend on the width, not only on the size.
+	if ( resized ) {
 		size = w * h;
 		resizeBuffers( );
 	}
 	
 	cre = re;
 	cim = im;
+	creLo = reLo;
+	cimLo = imLo;
 	scale = s;	
 	rangere = w / scale;
 	rangeim = h / scale;
@@ -196,7 +206,14 @@ void Buddha::set( double re, double im, double s, uint lr, uint lg, uint lb, uin
     highb = hb;
 	high = max( max( highr, highg ), highb );
     low = min( min(lowr, lowg), lowb);
-	resizeSequences( );
+
+	updatePrecision( );
+	importance.reset( );
+	// the iterations may be changed, so the contribute and max of the seeds are not valid
+	// anymore. If the view changed clearBuffers() empties the pool.
+	seeds.clear( );
+	// the cells are as big as some pixels, so they follow the mutations of the metropolis
+	periodicCells.clear( scale );
 	//status = RUN;
 	
 	if ( pause ) {
@@ -207,9 +224,189 @@ void Buddha::set( double re, double im, double s, uint lr, uint lg, uint lb, uin
 	emit settedValues( );
 }
 
+// at low magnification float is more than enough for the pixel grid. The float kernels
+// count the iterations in float too, so there is also a limit on them. At very high
+// magnification not even double is enough and the orbits are computed in double-double,
+// but only for the mandelbrot (the other formulas stay in double).
+void Buddha::updatePrecision ( ) {
+	const Precision old = precision;
+	double extent = max( max( max( fabs( minre ), fabs( maxre ) ), max( fabs( minim ), fabs( maxim ) ) ), 2.0 );
+	if ( 1.0 / scale > FLOAT_PIXEL_ULPS * FLT_EPSILON * extent && high < FLOAT_MAX_ITERATIONS )
+		precision = FLOAT_PRECISION;
+	else if ( 1.0 / scale > DOUBLE_PIXEL_ULPS * DBL_EPSILON * extent || formula != MANDELBROT_FORMULA )
+		precision = DOUBLE_PRECISION;
+	else
+		precision = DOUBLEDOUBLE_PRECISION;
+
+	// the seeds of the deep zoom are offsets from the center, the others are absolute points
+	if ( precision != old ) seeds.reset( );
+
+	// the deep zoom never saves the sequences, the orbits are drawn computing them again
+	twoPass = ( high > low && high - low >= TWOPASS_MIN_SEQUENCE ) || precision == DOUBLEDOUBLE_PRECISION;
+	resizeSequences( );
+	updatePeriodicity( );
+}
+
+// the parameters of the periodicity check for the actual strategy and view. All the strategies
+// save a point and compare every next one with it, saving again and doubling the distance
+// when they reach it:
+// - doubling starts after STEP iterations, with a fixed tolerance. This is the original one.
+// - Brent starts from the first iteration, so the point is saved at every power of two and the
+//   distance from it when the orbit comes back is the length of the cycle (his lambda), that
+//   is in the statistics. The short cycles are found earlier.
+// - adaptive starts like doubling, but the tolerance is a fraction of the pixel, so at low
+//   magnification the orbits are rejected well before they converge to FLT_EPSILON.
+// In the deep zoom the tolerance can't be bigger than a fraction of the pixel in any case.
+void Buddha::updatePeriodicity ( ) {
+	const double pixelTolerance = ( ADAPTIVE_PIXEL_FRACTION / scale ) * ( ADAPTIVE_PIXEL_FRACTION / scale );
+	periodicityStep = periodicity == BRENT_PERIODICITY ? 1 : STEP;
+	if ( periodicity == ADAPTIVE_PERIODICITY )
+		periodicityTolerance = min( max( pixelTolerance, (double) DBL_EPSILON * DBL_EPSILON ), ADAPTIVE_MAX_TOLERANCE );
+	else
+		periodicityTolerance = FLT_EPSILON * FLT_EPSILON;
+	if ( precision == DOUBLEDOUBLE_PRECISION )
+		periodicityTolerance = min( periodicityTolerance, pixelTolerance );
+}
+
+void Buddha::setPeriodicity ( int strategy ) {
+	qDebug() << "Buddha::setPeriodicity()" << strategy;
+	const bool running = generatorsStatus == RUN;
+	if ( running ) pauseGenerators( );
+	periodicity = (Periodicity) strategy;
+	updatePeriodicity( );
+	if ( running ) resumeGenerators( );
+}
+
+// 1 is the classic metropolis, 0 uses as many tries as the lanes of the kernels
+void Buddha::setTries ( int t ) {
+	qDebug() << "Buddha::setTries()" << t;
+	const bool running = generatorsStatus == RUN;
+	if ( running ) pauseGenerators( );
+	tries = min( max( t, 0 ), MAXLANES );
+	if ( running ) resumeGenerators( );
+}
+
+// 1 is a single chain, 0 as many chains as the lanes of the kernels. With more chains
+// the multiple-try mode is not used.
+void Buddha::setChains ( int c ) {
+	qDebug() << "Buddha::setChains()" << c;
+	const bool running = generatorsStatus == RUN;
+	if ( running ) pauseGenerators( );
+	chains = min( max( c, 0 ), MAXLANES );
+	if ( running ) resumeGenerators( );
+}
+
+void Buddha::setSampling ( int s ) {
+	qDebug() << "Buddha::setSampling()" << s;
+	const bool running = generatorsStatus == RUN;
+	if ( running ) pauseGenerators( );
+	sampling = (Sampling) s;
+	clearBuffers( );
+	if ( running ) resumeGenerators( );
+}
+
+// the generators start again from their streams of the new seed, the stream is for splitting a
+// render between processes or machines: each one with the same seed and a different stream
+void Buddha::setSeed ( qulonglong s, int stream ) {
+	qDebug() << "Buddha::setSeed()" << s << stream;
+	const bool running = generatorsStatus == RUN;
+	if ( running ) pauseGenerators( );
+	runSeed = s;
+	runStream = max( stream, 0 );
+	Random scrambler;
+	scrambler.seed( runSeed, runStream );
+	quasiRandom.scramble( scrambler );
+	if ( generatorsStatus != STOP )
+		for ( int i = 0; i < threads; ++i ) generators[i]->generator.seed( runSeed, runStream, i );
+	clearBuffers( );
+	if ( running ) resumeGenerators( );
+}
+
+// the same seed gives the same points only if the generators don't depend on each other, so
+// in a reproducible run they don't use the shared seed pool, periodic cache and importance map,
+// that are filled in the order the threads happen to run. Then every generator draws the
+// points of its stream, the same for the same seed, stream, view and number of threads. What
+// still depends on the timing is how many points every generator does before a pause (so the
+// image is the same only after the same number of steps), and in the quasi-random sampling
+// which generator takes the next block, but not which blocks are done.
+// The run is exact when started with the generators stopped: if they are running the chains
+// they have begun go on with the new stream.
+void Buddha::setReproducible ( bool r ) {
+	qDebug() << "Buddha::setReproducible()" << r;
+	const bool running = generatorsStatus == RUN;
+	if ( running ) pauseGenerators( );
+	reproducible = r;
+	setSeed( runSeed, runStream );
+	if ( running ) resumeGenerators( );
+}
+
+void Buddha::setBoundaryGuided ( bool guided ) {
+	qDebug() << "Buddha::setBoundaryGuided()" << guided;
+	const bool running = generatorsStatus == RUN;
+	if ( running ) pauseGenerators( );
+	boundaryGuided = guided;
+	if ( running ) resumeGenerators( );
+}
+
+// how the generators write the histogram: ATOMIC_HISTOGRAM increments the shared counters for
+// every point, TILECACHE_HISTOGRAM collects the points of the last tiles in every generator
+// and adds them together, it's better only with many threads on the same bright pixels.
+// The image is kept, the caches are written in pause.
+void Buddha::setHistogramStrategy ( int strategy ) {
+	qDebug() << "Buddha::setHistogramStrategy()" << strategy;
+	const bool running = generatorsStatus == RUN;
+	if ( running ) pauseGenerators( );
+	histogramStrategy = (HistogramStrategy) strategy;
+	if ( running ) resumeGenerators( );
+}
+
+// true if the generators take the points from the quasi-random sequence instead of running
+// the metropolis. The deep zoom always uses the metropolis: its window is too small.
+bool Buddha::quasiRandomSampling ( ) {
+	if ( precision == DOUBLEDOUBLE_PRECISION ) return false;
+	return sampling == QUASIRANDOM_SAMPLING || ( sampling == AUTOMATIC_SAMPLING && rangere * rangeim >= QUASIRANDOM_MIN_AREA );
+}
+
+// changes the fractal and the orbits that are drawn. The generators choose again their
+// kernels and the image starts from zero.
+void Buddha::setFractal ( int f, bool b ) {
+	qDebug() << "Buddha::setFractal()" << f << b;
+	const bool running = generatorsStatus == RUN;
+	if ( running ) pauseGenerators( );
+	formula = (Formula) f;
+	bounded = b;
+	updatePrecision( );
+	importance.reset( );
+	periodicCells.clear( scale );
+	if ( generatorsStatus != STOP )
+		for ( int i = 0; i < threads; ++i ) generators[i]->selectKernels( );
+	clearBuffers( );
+	if ( running ) resumeGenerators( );
+}
+
+// sums the statistics of the generators, they must be stopped or paused
+void Buddha::printPeriodicityStats ( ) {
+	static const char* names[PERIODICITY_STRATEGIES] = { "doubling", "Brent", "adaptive" };
+	for ( int s = 0; s < PERIODICITY_STRATEGIES; ++s ) {
+		PeriodicityStats sum = { 0, 0, 0, 0, 0 };
+		for ( int i = 0; i < threads; ++i ) {
+			const PeriodicityStats& g = generators[i]->periodicityStats[s];
+			sum.rejected += g.rejected;
+			sum.rejectedIterations += g.rejectedIterations;
+			sum.cycles += g.cycles;
+			sum.undetected += g.undetected;
+			sum.undetectedIterations += g.undetectedIterations;
+		}
+		if ( sum.rejected + sum.undetected == 0 ) continue;
+		qDebug() << "Periodicity" << names[s] << ":" << sum.rejected << "points rejected in"
+			 << (double) sum.rejectedIterations / max( sum.rejected, 1ULL ) << "iterations on average, cycles of"
+			 << (double) sum.cycles / max( sum.rejected, 1ULL ) << "points,"
+			 << sum.undetected << "not detected (" << sum.undetectedIterations << "iterations )";
+	}
+}
+
 Buddha::~Buddha ( ) {
 	qDebug() << "Buddha::~Buddha()";
-	free( raw );
 	free( RGBImage );
 }
 
@@ -225,7 +422,7 @@ void Buddha::changeThreadNumber ( int threads ) {
 		// in every case if some slots in the array are empty I fill them
 		if ( !generators[i] ) generators[i] = new BuddhaGenerator;
 		// if we're running or in pause and I've created a new generator I have still to initialize it
-		if ( generatorsStatus != STOP ) generators[i]->initialize( this );
+		if ( generatorsStatus != STOP ) generators[i]->initialize( this, i );
 		// if we're running I start the new generator
 		if ( generatorsStatus == RUN ) generators[i]->start( );
 	}
@@ -251,20 +448,26 @@ void Buddha::changeThreadNumber ( int threads ) {
 
 void Buddha::resizeSequences( ) {
 	for ( int i = 0; i < threads; ++i ) {
+		// in the two pass mode the memory is also released
+		if ( twoPass ) {
+			vector<complex<double>>().swap( generators[i]->seq );
+			continue;
+		}
+
 		int size = (int) high - (int) low;
 		if ( size >= 0 && (int) generators[i]->seq.size() != size )
 		     generators[i]->seq.resize( size );
 	}
 }
 
+// the generators can't be running: a splat written by a flush in the middle of this would go in
+// the old histogram, or with the old pixels in the new one. The paused ones flushed everything.
 void Buddha::resizeBuffers( ) {
 	qDebug() << "Buddha::resizeBuffers()";
+	const bool running = generatorsStatus == RUN;
+	if ( running ) pauseGenerators( );
 	mutex.lock();
-#if QTOPENCL
-	raw = (unsigned int*) realloc( raw, size * 4 * sizeof( unsigned int ) );
-#else
-	raw = (unsigned int*) realloc( raw, size * 3 * sizeof( unsigned int ) );
-#endif
+	histogram.resize( w, h );
 	RGBImage = (unsigned int*) realloc( RGBImage, size * sizeof( unsigned int ) );
 	mutex.unlock();
 
@@ -274,33 +477,45 @@ void Buddha::resizeBuffers( ) {
 	convert.setLocalWorkSize( convert.bestLocalWorkSizeImage2D() );
 	dstImageBuffer = context.createImage2DDevice( QImage::Format_RGB32, QSize( w, h ), QCLMemoryObject::WriteOnly );
 #endif
-	
-	
+
+	// the pixels of the counts in the caches are not the same anymore
 	for ( int i = 0; i < threads; ++i ) {
-		QMutexLocker( &generators[i]->mutex );
-		// could be done also indirectly but it not so costly
-		generators[i]->raw = (unsigned int*) realloc( generators[i]->raw, 3 * size * sizeof( unsigned int ) );
+		QMutexLocker locker( &generators[i]->mutex );
+		generators[i]->splats.attach( histogram.size( ) );
+		generators[i]->tiles.discard( );
 	}
+	if ( running ) resumeGenerators( );
 }
 
+// the same of resizeBuffers(), the caches can be discarded only with the generators paused
 void Buddha::clearBuffers ( ) {
 	qDebug() << "Buddha::clearBuffers()";
+	const bool running = generatorsStatus == RUN;
+	if ( running ) pauseGenerators( );
 	mutex.lock();
 	memset( RGBImage, 0, size * sizeof( int ) );
-	memset( raw, 0, 3 * size * sizeof( int ) );
+	histogram.clear( );
 	mutex.unlock();
 	
+	// the statistics are for the actual view, so they are reported before losing them
+	printPeriodicityStats( );
 	for ( int i = 0; i < threads; ++i ) {
-		QMutexLocker( &generators[i]->mutex );
+		QMutexLocker locker( &generators[i]->mutex );
 		// could be done also indirectly but it not so costly
-		if ( generators[i]->raw ) memset( generators[i]->raw, 0, 3 * size * sizeof( int ) );
+		generators[i]->splats.discard( );
+		generators[i]->tiles.discard( );
+		memset( generators[i]->periodicityStats, 0, sizeof( generators[i]->periodicityStats ) );
+		generators[i]->radiusScale = 1.0;
 	}
+	seeds.reset( );
+	quasiRandom.restart( );
+	if ( running ) resumeGenerators( );
 }
 
 void Buddha::startGenerators ( ) {
 	qDebug() << "Buddha::startGenerators()";
 	for ( int i = 0; i < threads; ++i ) {
-		generators[i]->initialize( this );
+		generators[i]->initialize( this, i );
 		generators[i]->start( );
 	}
 
@@ -328,6 +543,7 @@ void Buddha::stopGenerators ( ) {
 	if ( generatorsStatus == RUN )
 		semaphore.acquire( threads );
 
+	printPeriodicityStats( );
 	emit stoppedGenerators( true );
 	generatorsStatus = STOP;
 }
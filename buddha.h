@@ -42,11 +42,53 @@
 #include <QDebug>
 #include <complex>
 #include "staticStuff.h"
+#include "interiorMap.h"
+#include "importanceMap.h"
+#include "seedPool.h"
+#include "quasiRandom.h"
+#include "periodicCache.h"
+#include "histogram.h"
+#include "formula.h"
 
 
 using namespace std;
 
+// over this number of saved points per orbit (high - low) the generators don't keep the
+// sequence anymore: they first only test escape and contribute, then they compute again the
+// orbits that will be drawn. 2^20 points are 16 MB for every thread.
+#define TWOPASS_MIN_SEQUENCE	( 1 << 20 )
+
+// the iterations are done in single precision if a pixel is at least this number of
+// float epsilons wide, relative to the farthest coordinate of the window. The same for
+// double, under that the double-double deep zoom is used.
+#define FLOAT_PIXEL_ULPS	64
+#define DOUBLE_PIXEL_ULPS	64
+
+// the adaptive periodicity check uses as tolerance this fraction of a pixel, but never more
+// than ADAPTIVE_MAX_TOLERANCE (squared) to not lose too many orbits that escape slowly
+#define ADAPTIVE_PIXEL_FRACTION	1.0e-2
+#define ADAPTIVE_MAX_TOLERANCE	1.0e-10
+
+// with the automatic sampling the quasi-random one is used when the window is at least this
+// big (area in the complex plane), there the metropolis is not much better than it
+#define QUASIRANDOM_MIN_AREA	1.0
+
 enum CurrentStatus { PAUSE, STOP, RUN };
+enum Precision { FLOAT_PRECISION, DOUBLE_PRECISION, DOUBLEDOUBLE_PRECISION };
+
+// the ways of finding the periodic orbits, see Buddha::updatePeriodicity()
+enum Periodicity { DOUBLING_PERIODICITY, BRENT_PERIODICITY, ADAPTIVE_PERIODICITY, PERIODICITY_STRATEGIES };
+
+// how the generators choose the points, see Buddha::quasiRandomSampling()
+enum Sampling { METROPOLIS_SAMPLING, QUASIRANDOM_SAMPLING, AUTOMATIC_SAMPLING };
+
+// what the periodicity check costs: the iterations spent on the points found periodic and on
+// the points that reached the iteration limit without being found (treated as periodic too).
+// cycles is the sum of the cycle lengths found, see BuddhaGenerator::countPeriodicity().
+struct PeriodicityStats {
+	unsigned long long rejected, rejectedIterations, cycles;
+	unsigned long long undetected, undetectedIterations;
+};
 
 class BuddhaGenerator;
 
@@ -73,6 +115,7 @@ public:
 	double maxre, maxim;
 	double minre, minim;
 	double cre, cim;
+	double creLo, cimLo;	// the low part of the center, not zero only in deep zooms
     unsigned int low, high;
     unsigned int lowr, lowg, lowb;
     unsigned int highr, highg, highb;
@@ -82,21 +125,44 @@ public:
 	double rangere, rangeim;
     unsigned int w, h;
 	unsigned int size;
+	bool twoPass;		// if true the generators don't save the sequences, see TWOPASS_MIN_SEQUENCE
+	Precision precision;	// the precision of the iterations, see FLOAT_PIXEL_ULPS
+	Formula formula;	// the fractal, only the mandelbrot has the deep zoom
+	bool bounded;		// true for the anti-buddhabrot, that draws the orbits that don't escape
+	Periodicity periodicity;
+	unsigned int tries;	// proposals for every step of the metropolis, see BuddhaGenerator::multipleTry()
+	unsigned int chains;	// metropolis chains of every generator, see BuddhaGenerator::multipleChains()
+	unsigned int periodicityStep;	// first iteration of the periodicity check
+	double periodicityTolerance;	// squared distance under which two points are the same
+	InteriorMap interior;	// the cells inside the set, used by the generators to skip the points
+	ImportanceMap importance;	// where findPoint() starts, built by the generators for every view
+	SeedPool seeds;		// where the metropolis chains of all the generators ended
+	PeriodicCache periodicCells;	// the cells found inside the set while rendering
+	Sampling sampling;
+	QuasiRandomSequence quasiRandom;	// the points of the quasi-random sampling, shared by the generators
+	bool boundaryGuided;	// if findPoint() moves toward the boundary of the set, see BuddhaGenerator::distanceEstimate()
+	quint64 runSeed;	// all the random numbers of a run come from it, see Random::seed()
+	unsigned int runStream;	// the runs with the same seed and different streams never overlap
+	bool reproducible;	// the generators don't use what the others found, see setReproducible()
 	
 	// things for the plot
-	unsigned int* raw;		// i want to avoid this in the future XXX
+	Histogram histogram;	// the counts of all the generators, see TileCache
+	HistogramStrategy histogramStrategy;
 	unsigned int* RGBImage;	// here will be built the QImage
 	float rmul, gmul, bmul, realContrast, realLightness;
 	int contrast, lightness;
-	unsigned int maxr, minr, maxb, minb, maxg, ming;
+	quint64 maxr, maxg, maxb;
 	
     // Constructor & Destructor
 	Buddha ( QObject *parent = 0 );
 	~Buddha ( );
 
-    void reduceStep ( int i, bool check );
-	void reduce ( );
+	void findMaximum ( );
 	void run( );
+	void updatePrecision ( );
+	void updatePeriodicity ( );
+	bool quasiRandomSampling ( );
+	void printPeriodicityStats ( );
 
 signals:
 	void imageCreated( );
@@ -111,7 +177,7 @@ public slots:
 	void updateRGBImage( );
 	void pauseGenerators( );
 	void resumeGenerators( );
-    void set( double cre, double cim, double scale, uint lr, uint lg, uint lb, uint hr, uint hg, uint hb, QSize wsize, bool pause );
+    void set( double cre, double cim, double creLo, double cimLo, double scale, uint lr, uint lg, uint lb, uint hr, uint hg, uint hb, QSize wsize, bool pause );
 	void clearBuffers ( );
 	void resizeBuffers ( );
 	void resizeSequences ( );
@@ -119,6 +185,15 @@ public slots:
 	void saveScreenshot ( QString fileName );
 	void setContrast( int value );
 	void setLightness( int value );
+	void setPeriodicity( int strategy );
+	void setFractal( int formula, bool bounded );
+	void setTries( int tries );
+	void setChains( int chains );
+	void setSampling( int sampling );
+	void setSeed( qulonglong seed, int stream );
+	void setReproducible( bool reproducible );
+	void setBoundaryGuided( bool guided );
+	void setHistogramStrategy( int strategy );
 };
 
 
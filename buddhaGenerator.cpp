@@ -28,7 +28,6 @@
 
 #include "buddhaGenerator.h"
 #include "staticStuff.h"
-#define STEP		16
 #define METTHD		16000
 
 using namespace std;
@@ -38,35 +37,48 @@ using namespace std;
 #endif
 
 
-void BuddhaGenerator::initialize ( Buddha* b ) {
+void BuddhaGenerator::initialize ( Buddha* b, int index ) {
 	//qDebug() << "BuddhaGenerator::initialize()";
 	this->b = b;
+	this->index = index;
 
-	seed = powf ( (unsigned long int) this & 0xFF, M_PI ) + ( ( (unsigned long int) this >> 16 ) & 0xFFFF );
-	generator.seed( seed );
+	// every generator has its own stream of the run, so a run can be done again exactly
+	generator.seed( b->runSeed, b->runStream, index );
 	
-	// TODO : Add tests
-	raw = (unsigned int*) realloc( raw, 3 * b->size * sizeof( unsigned int ) );
-	memset( raw, 0, 3 * b->size * sizeof( unsigned int ) );
-	seq.resize( b->high - b->low );
+	splats.attach( b->histogram.size( ) );
+	tiles.attach( &b->histogram );
+	if ( b->twoPass ) seq.clear( );
+	else seq.resize( b->high - b->low );
+
+	selectKernels( );
 	
 	status = RUN;
 	
-	qDebug() << "Initialized generator" << (void*) this << "with seed" << seed;
+	qDebug() << "Initialized generator" << index << "with seed" << b->runSeed << "stream" << b->runStream << "and" << laneWidth << "lanes";
 }
 
 bool BuddhaGenerator::flow ( ) {
 	
+	// the Buddha may read or clear the histogram as soon as we are paused, so everything
+	// in the cache is written before
 	if ( status == PAUSE ) {
+		flushSplats( );
+		tiles.flush( );
 		b->semaphore.release( 1 );
 		resumeCondition.wait( &mutex );
 	} else if ( status == STOP ) {
+		flushSplats( );
+		tiles.flush( );
 		return false;
 	}
 
 	return true;
 }
 
+void BuddhaGenerator::flushSplats ( ) {
+	splats.flush( b->histogramStrategy == TILECACHE_HISTOGRAM ? &tiles : NULL, &b->histogram );
+}
+
 
 void BuddhaGenerator::pause ( ) {
 	status = PAUSE;
@@ -83,23 +95,26 @@ void BuddhaGenerator::stop ( ) {
 
 
 
-void BuddhaGenerator::drawPoint ( complex<double>& c, bool drawr, bool drawg, bool drawb ) {
+// T is the precision used for the projection on the screen, see Buddha::set()
+template <class T>
+void BuddhaGenerator::drawPoint ( complex<T>& c, bool drawr, bool drawg, bool drawb ) {
 
 	register unsigned int x, y;
-	const double scale = b->scale;
-	const unsigned int w = b->w;
-	const double minim = b->minim;
-	const double maxim = b->maxim;
-	const double minre = b->minre;
-	const double maxre = b->maxre;
+	const T scale = (T) b->scale;
+	const unsigned int tiles = b->histogram.tilesInRow( );
+	const T minim = (T) b->minim;
+	const T maxim = (T) b->maxim;
+	const T minre = (T) b->minre;
+	const T maxre = (T) b->maxre;
+
 
+	const unsigned int mask = drawr * RED_CHANNEL | drawg * GREEN_CHANNEL | drawb * BLUE_CHANNEL;
+	if ( !mask ) return;
 
-	#define plotIm( c, drawr, drawg, drawb ) \
+	#define plotIm( c ) \
 	if ( c.imag() > minim && c.imag() < maxim ) { \
 		y = ( maxim - c.imag() ) * scale; \
-		if ( drawb )	raw[ y * 3 * w + 3 * x + 2 ]++;	\
-		if ( drawr )	raw[ y * 3 * w + 3 * x + 0 ]++;	\
-		if ( drawg )	raw[ y * 3 * w + 3 * x + 1 ]++;	\
+		splat( tiledPixel( x, y, tiles ), mask ); \
 	}
 	
 	if ( c.real() < minre ) return;
@@ -110,18 +125,50 @@ void BuddhaGenerator::drawPoint ( complex<double>& c, bool drawr, bool drawg, bo
 	
     // the y coordinates are referred to the point (b->minre, b->maxim), and are symetric in
 	// respect of the real axis (re = 0). So I draw always also the simmetric point (I try).
-	plotIm( c, drawr, drawg, drawb );
-	plotIm( complex<double>(c.real(),-c.imag()), drawr, drawg, drawb );
+	plotIm( c );
+	plotIm( complex<T>(c.real(),-c.imag()) );
+}
+
+
+// the same of drawPoint() for the deep zoom. re and im are the offsets of the point from the
+// center of the window, conjim is the imaginary offset of the simmetric point.
+void BuddhaGenerator::drawDeepPoint ( double re, double im, double conjim, bool drawr, bool drawg, bool drawb ) {
+
+	unsigned int x, y;
+	const double scale = b->scale;
+	const unsigned int tiles = b->histogram.tilesInRow( );
+	const double halfre = 0.5 * b->rangere;
+	const double halfim = 0.5 * b->rangeim;
+
+	const unsigned int mask = drawr * RED_CHANNEL | drawg * GREEN_CHANNEL | drawb * BLUE_CHANNEL;
+	if ( !mask ) return;
+
+	#define plotDeepIm( im ) \
+	if ( im > -halfim && im < halfim ) { \
+		y = ( halfim - im ) * scale; \
+		splat( tiledPixel( x, y, tiles ), mask ); \
+	}
+
+	if ( re < -halfre ) return;
+	if ( re > halfre ) return;
+
+	x = ( re + halfre ) * scale;
+
+	plotDeepIm( im );
+	plotDeepIm( conjim );
 }
 
 
-// test if a point is inside the interested area
-int BuddhaGenerator::inside ( complex<double>& c ) {
+// test if a point is inside the interested area, the simmetric point counts only if it's drawn
+template <class F, class T>
+int BuddhaGenerator::inside ( complex<T>& c ) {
+	const T maxre = (T) b->maxre, minre = (T) b->minre;
+	const T maxim = (T) b->maxim, minim = (T) b->minim;
 
-	return  c.real() <= b->maxre &&
-                c.real() >= b->minre &&
-				( ( c.imag() <= b->maxim && c.imag() >= b->minim ) ||
-                ( -c.imag() <= b->maxim && -c.imag() >= b->minim ) );
+	return  c.real() <= maxre &&
+                c.real() >= minre &&
+				( ( c.imag() <= maxim && c.imag() >= minim ) ||
+                ( F::symmetric && -c.imag() <= maxim && -c.imag() >= minim ) );
 		
 	//return  c.re <= b->maxre && c.re >= b->minre && c.im <= b->maxim && c.im >= b->minim ;
 }
@@ -129,66 +176,66 @@ int BuddhaGenerator::inside ( complex<double>& c ) {
 
 
 // this is the main function. Here little modifications impacts a lot on the speed of the program!
+// If saveSequence is false the points are not saved in seq, and the orbits that have to be
+// drawn must be computed again with drawOrbit().
+// T is the precision of the iteration, float is used at low magnification (see Buddha::set()).
+// F is the formula, A says if the orbits given back are the escaping or the bounded ones.
+// I tried doing the iterations in blocks, testing escape and periodicity only at the end of
+// the block and doing again the last one, but the inside and distance tests are needed for every
+// point anyway, and on the out of order cpus the tests are already hidden behind the latency of
+// the multiplications: blocks of 4 to 16 were the same or 10-40% slower, so there are no blocks.
+template <class T, bool saveSequence, class F, class A>
 int BuddhaGenerator::evaluate ( complex<double>& begin, double& centerDistance,
 				unsigned int& contribute, unsigned int& calculated ) {
 
-	complex<double> last = begin;	// holds the last calculated point
-	complex<double> critical = last;// for periodicity check
+	const complex<T> c( (T) begin.real(), (T) begin.imag() );
+	complex<T> last = c;		// holds the last calculated point
+	complex<T> critical = last;	// for periodicity check
 
-	unsigned int j = 0, criticalStep = STEP;
-	double tmp = 64.0;
+	unsigned int j = 0, criticalStep = b->periodicityStep;
+	T tmp = 64, distance = 64, zr, zi;
 	bool isInside;
 	centerDistance = 64.0;
 	contribute = 0;
-    
-	const double cr = begin.real();
-    const double ci = begin.imag();
-    const double ci2 = ci*ci;
 
 	const unsigned int low = b->low;
 	const unsigned int high = b->high;
-	const double cre = b->cre;
-	const double cim = b->cim;
-
-
-    //Quick rejection check if c is in 2nd order period bulb
-     if( (cr+1.0) * (cr+1.0) + ci2 < 0.0625) return -1;
+	const T cre = (T) b->cre;
+	const T cim = (T) b->cim;
+	const T tolerance = (T) b->periodicityTolerance;
 
-     //Quick rejection check if c is in main cardioid
-     double q = (cr-0.25)*(cr-0.25) + ci2;
-     if( q*(q+(cr-0.25)) < 0.25*ci2) return -1;
 
-
-     // test for the smaller bulb left of the period-2 bulb
-     if (( ((cr+1.309)*(cr+1.309)) + ci*ci) < 0.00345) return -1;
-
-     // check for the smaller bulbs on top and bottom of the cardioid
-     if ((((cr+0.125)*(cr+0.125)) + (ci-0.744)*(ci-0.744)) < 0.0088) return -1;
-     if ((((cr+0.125)*(cr+0.125)) + (ci+0.744)*(ci+0.744)) < 0.0088) return -1;
+	// quick rejection of the points in the main cardioid, in the biggest bulbs and in the
+	// interior map (only of the mandelbrot, and only if we don't want them)
+	if ( F::knownInterior && A::escaping && insideKnownInterior( b->interior.view( ), begin.real(), begin.imag() ) ) {
+		calculated = 0;
+		return -1;
+	}
 
 	for ( unsigned int i = 0; i < high; ++i ) {
 		// when low <= i < high the points are saved for drawing
-		if ( i >= low ) seq[j++] = last;
+		if ( saveSequence && i >= low ) seq[j++] = complex<double>( last.real(), last.imag() );
 
 		// this checks if the last point is inside the screen
-		if ( ( isInside = inside( last ) ) ) {
-			centerDistance = 0.0;
+		if ( ( isInside = inside<F>( last ) ) ) {
+			distance = 0;
 			++contribute;
 		}
 
 		// if we didn't passed inside the screen calculate the distance
-		// it will update after the variable centerDistance
-		if ( centerDistance != 0.0 ) {
+		// it will update after the variable distance
+		if ( distance != 0 ) {
 			tmp = ( last.real() - cre ) * ( last.real() - cre ) +
 			      ( last.imag() - cim ) * ( last.imag() - cim );
-			if ( tmp < centerDistance && norm(last) < 4.0 ) centerDistance = tmp;
+			if ( tmp < distance && norm(last) < 4 ) distance = tmp;
 		}
 
 		// test the stop condition and eventually continue a little bit
-		if ( norm(last) > 4.0 ) {
+		if ( norm(last) > 4 ) {
 			if ( !isInside ) {
 				calculated = i;
-				return i - 1;
+				centerDistance = distance;
+				return A::escaping ? i - 1 : -1;
 			}
 		}
 
@@ -202,9 +249,10 @@ int BuddhaGenerator::evaluate ( complex<double>& begin, double& centerDistance,
 			// if I found that two calculated points are very very close I conclude that
 			// they are the same point, so the sequence is periodic so we are computing a point
 			// in the mandelbrot, so I stop the calculation
-			if ( tmp < FLT_EPSILON * FLT_EPSILON ) { // maybe also DBL_EPSILON is sufficient
+			if ( tmp < tolerance ) {
 				calculated = i;
-				return -1;
+				centerDistance = distance;
+				return A::escaping ? -1 : (int) i;
 			}
 
 			// I don't do this step at every iteration to be more fast, I found that a very good
@@ -216,12 +264,174 @@ int BuddhaGenerator::evaluate ( complex<double>& begin, double& centerDistance,
 		}
 
 
-		tmp = last.real() * last.real() - last.imag() * last.imag() + begin.real();
-		last = complex<double>(tmp, 2.0 * last.real() * last.imag() + begin.imag());
+		zr = last.real();
+		zi = last.imag();
+		F::template step< ScalarLane<T> >( zr, zi, zr * zr, zi * zi, c.real(), c.imag() );
+		last = complex<T>( zr, zi );
 	}
 	
+	// the bounded orbits are drawn up to the last point computed
 	calculated = high;
-	return -1;
+	centerDistance = distance;
+	return A::escaping ? -1 : (int) high - 1;
+}
+
+
+// evaluates a proposal with the precision and the mode chosen by Buddha::set()
+template <class F, class A>
+int BuddhaGenerator::evaluateProposal ( complex<double>& begin, double& centerDistance,
+				unsigned int& contribute, unsigned int& calculated ) {
+	int max;
+	if ( knownPeriodic( begin.real(), begin.imag() ) ) {
+		centerDistance = 64.0;
+		contribute = calculated = 0;
+		return -1;
+	}
+
+	if ( b->precision == DOUBLEDOUBLE_PRECISION ) {
+		// one point, the scalar kernel is enough
+		const double re = begin.real(), im = begin.imag();
+		LaneResult result;
+		evaluateDeepScalar( deepView( ), &re, &im, 1, &result );
+		centerDistance = result.centerDistance;
+		contribute = result.contribute;
+		calculated = result.calculated;
+		max = result.max;
+	} else if ( b->precision == FLOAT_PRECISION ) {
+		if ( b->twoPass ) max = evaluate<float, false, F, A>( begin, centerDistance, contribute, calculated );
+		else max = evaluate<float, true, F, A>( begin, centerDistance, contribute, calculated );
+	} else {
+		if ( b->twoPass ) max = evaluate<double, false, F, A>( begin, centerDistance, contribute, calculated );
+		else max = evaluate<double, true, F, A>( begin, centerDistance, contribute, calculated );
+	}
+
+	countPeriodicity( max, calculated );
+	learnPeriodicity( begin.real(), begin.imag(), max, calculated );
+	return max;
+}
+
+
+// the points that escape and the ones rejected before iterating (calculated is 0) don't
+// say anything about the periodicity check. In the anti-buddhabrot max is -1 for the
+// points that escape.
+// A periodic point is found at the iteration calculated comparing it with the point saved
+// at the last step before it (the steps double from periodicityStep, and the comparison is
+// done before the doubling), so the cycle is the distance between them.
+inline void BuddhaGenerator::countPeriodicity ( int max, unsigned int calculated ) {
+	if ( ( max == -1 ) == b->bounded || calculated == 0 ) return;
+	PeriodicityStats& s = periodicityStats[b->periodicity];
+	if ( calculated < b->high ) {
+		unsigned int saved = b->periodicityStep;
+		while ( saved * 2 < calculated ) saved *= 2;
+		++s.rejected;
+		s.rejectedIterations += calculated;
+		s.cycles += calculated - saved;
+	} else {
+		++s.undetected;
+		s.undetectedIterations += calculated;
+	}
+}
+
+// true if c is in a cell of the PeriodicCache that is surely inside, then it can be rejected
+// without iterating. Only in the buddhabrot (the anti-buddhabrot wants these points) and not
+// in the deep zoom, where the points are offsets. The random number is drawn for every point,
+// so the stream of the generator doesn't depend on what the cache knows.
+inline bool BuddhaGenerator::knownPeriodic ( double re, double im ) {
+	const bool recheck = generator.integer( ) % PERIODICCACHE_RECHECK == 0;
+	if ( b->bounded || b->precision == DOUBLEDOUBLE_PRECISION || b->reproducible ) return false;
+	return !recheck && b->periodicCells.interior( re, im );
+}
+
+// only the points found periodic count for the cells, the ones that reached the limit of
+// iterations are not proved. The ones rejected before iterating say nothing.
+inline void BuddhaGenerator::learnPeriodicity ( double re, double im, int max, unsigned int calculated ) {
+	if ( b->bounded || b->precision == DOUBLEDOUBLE_PRECISION || calculated == 0 ) return;
+	if ( max != -1 ) b->periodicCells.escaping( re, im );
+	else if ( calculated < b->high ) b->periodicCells.periodic( re, im );
+}
+
+
+
+// second pass of the two pass mode: computes again the orbit of begin and draws the
+// points from low to max, exactly the ones the metropolis would draw from seq.
+template <class T, class F>
+void BuddhaGenerator::drawOrbit ( complex<double>& begin, int max ) {
+	const complex<T> c( (T) begin.real(), (T) begin.imag() );
+	complex<T> last = c;
+	T zr, zi;
+	const unsigned int low = b->low;
+	complex<double> points[DRAWCHUNK];
+	int n = 0;
+	unsigned int first = low;
+
+	for ( int i = 0; i <= max; ++i ) {
+		if ( i >= (int) low ) {
+			points[n++] = complex<double>( last.real(), last.imag() );
+			if ( n == DRAWCHUNK ) {
+				drawPoints( points, n, first );
+				first += n;
+				n = 0;
+			}
+		}
+
+		zr = last.real();
+		zi = last.imag();
+		F::template step< ScalarLane<T> >( zr, zi, zr * zr, zi * zi, c.real(), c.imag() );
+		last = complex<T>( zr, zi );
+	}
+
+	drawPoints( points, n, first );
+}
+
+
+// draws n points of an orbit, first is the iteration of the first one. The points are divided
+// in pieces where the channels to draw don't change, then every piece is projected on the
+// screen by the vectorized kernel and only after the pixels are incremented. This way there
+// are no calls and no band tests for every point.
+void BuddhaGenerator::drawPoints ( const complex<double>* points, int n, unsigned int first ) {
+	unsigned int pixels[2 * DRAWCHUNK];
+	const ProjectView view = projectView( );
+	// the iterations where a channel starts or stops to be drawn
+	const unsigned int bounds[6] = { b->lowr + 1, b->highr, b->lowg + 1, b->highg, b->lowb + 1, b->highb };
+	const unsigned int end = first + n;
+	unsigned int next;
+
+	for ( unsigned int i = first; i < end; i = next ) {
+		next = min( end, i + DRAWCHUNK );
+		for ( int k = 0; k < 6; ++k )
+			if ( bounds[k] > i && bounds[k] < next ) next = bounds[k];
+
+		const unsigned int mask = ( i < b->highr && i > b->lowr ) * RED_CHANNEL |
+					  ( i < b->highg && i > b->lowg ) * GREEN_CHANNEL |
+					  ( i < b->highb && i > b->lowb ) * BLUE_CHANNEL;
+		if ( !mask ) continue;
+
+		const int count = projectPoints( view, (const double*) ( points + ( i - first ) ), next - i, pixels );
+		for ( int k = 0; k < count; ++k ) splat( pixels[k], mask );
+	}
+}
+
+
+
+// drawOrbit() for the deep zoom, the orbit is computed in double-double a piece at a time
+void BuddhaGenerator::drawDeepOrbit ( complex<double>& begin, int max ) {
+	double re[DEEPCHUNK], im[DEEPCHUNK], conjim[DEEPCHUNK];
+	const DeepView view = deepView( );
+	const unsigned int low = b->low;
+	DeepOrbit orbit;
+
+	deepOrbitStart( view, begin.real(), begin.imag(), orbit );
+	for ( int i = 0; i <= max; i += DEEPCHUNK ) {
+		const int n = min( DEEPCHUNK, max - i + 1 );
+		deepOrbitNext( view, orbit, n, re, im, conjim );
+
+		for ( int k = 0; k < n; ++k ) {
+			const unsigned int u = i + k;
+			if ( u >= low )
+				drawDeepPoint( re[k], im[k], conjim[k], u < b->highr && u > b->lowr,
+					       u < b->highg && u > b->lowg, u < b->highb && u > b->lowb );
+		}
+	}
 }
 
 
@@ -239,52 +449,545 @@ inline void BuddhaGenerator::exponentialMutation ( complex<double>& z, double ra
 }
 
 
+// the kernels for the formula and the instruction set. Called again by Buddha::setFractal()
+// while the generator is paused.
+void BuddhaGenerator::selectKernels ( ) {
+	evaluateLanes = selectEvaluateLanes( laneWidth, false, b->formula, b->bounded );
+	evaluateLanesFloat = selectEvaluateLanes( laneWidthFloat, true, b->formula, b->bounded );
+	evaluateDeep = selectEvaluateDeep( laneWidthDeep, b->bounded );
+	evaluateDeepScalar = selectDeepLanesScalar( b->bounded );
+	projectPoints = selectProjectPoints( );
+}
+
+
+// The proposals of the metropolis are a mixture, like in the Kelemen's MLT. Most of the
+// times a small mutation of ok, but with LARGESTEP_PROBABILITY a point taken without looking
+// at ok: half of the times uniformly in the square of the importance map, half from the map
+// itself when it's ready. So the chains can jump between far regions and don't stay for
+// all their steps where they started. The large steps are not simmetric: the result is the
+// correction q(ok) / q(proposal) that multiplies alpha, where q is their density.
+// The deep zoom does only small steps, its points are offsets from the center.
+double BuddhaGenerator::propose ( const complex<double>& ok, complex<double>& proposal, double radius, bool& large ) {
+	const double side = IMPORTANCE_MAX - IMPORTANCE_MIN;
+	proposal = ok;
+	large = b->precision != DOUBLEDOUBLE_PRECISION && generator.real() < LARGESTEP_PROBABILITY;
+	if ( !large ) {
+		exponentialMutation( proposal, generator.real() * radius );
+		return 1.0;
+	}
+
+	const bool importance = !b->reproducible && b->importance.ready( );
+	if ( importance && generator.real() < 0.5 ) {
+		double re, im;
+		b->importance.sample( generator, re, im );
+		proposal = complex<double>( re, im );
+	} else {
+		proposal = complex<double>( IMPORTANCE_MIN + generator.real() * side, IMPORTANCE_MIN + generator.real() * side );
+	}
+
+	// the uniform density alone is the same for all the points
+	if ( !importance ) return 1.0;
+	return largeStepDensity( ok ) / largeStepDensity( proposal );
+}
+
+double BuddhaGenerator::largeStepDensity ( const complex<double>& c ) {
+	const double side = IMPORTANCE_MAX - IMPORTANCE_MIN;
+	if ( !( c.real() >= IMPORTANCE_MIN && c.real() < IMPORTANCE_MAX && c.imag() >= IMPORTANCE_MIN && c.imag() < IMPORTANCE_MAX ) )
+		return 0.0;
+	return 0.5 / ( side * side ) + 0.5 * b->importance.density( c.real(), c.imag() );
+}
+
+
+KernelView BuddhaGenerator::kernelView ( ) {
+	KernelView v;
+	v.minre = b->minre;
+	v.maxre = b->maxre;
+	v.minim = b->minim;
+	v.maxim = b->maxim;
+	v.cre = b->cre;
+	v.cim = b->cim;
+	v.high = b->high;
+	v.interior = b->interior.view( );
+	v.periodicityStep = b->periodicityStep;
+	v.periodicityTolerance = b->periodicityTolerance;
+	return v;
+}
+
+ProjectView BuddhaGenerator::projectView ( ) {
+	ProjectView v;
+	v.minre = b->minre;
+	v.maxre = b->maxre;
+	v.minim = b->minim;
+	v.maxim = b->maxim;
+	v.scale = b->scale;
+	v.tiles = b->histogram.tilesInRow( );
+	v.symmetric = symmetricFormula( b->formula );
+	return v;
+}
+
+DeepView BuddhaGenerator::deepView ( ) {
+	DeepView v;
+	v.cre = b->cre;
+	v.creLo = b->creLo;
+	v.cim = b->cim;
+	v.cimLo = b->cimLo;
+	v.halfre = 0.5 * b->rangere;
+	v.halfim = 0.5 * b->rangeim;
+	// in the deep zoom this is already smaller than the pixels, see Buddha::updatePeriodicity()
+	v.tolerance = b->periodicityTolerance;
+	v.periodicityStep = b->periodicityStep;
+	v.high = b->high;
+	v.interior = b->interior.view( );
+	return v;
+}
+
+
+// the lanes of the kernel for the actual precision
+int BuddhaGenerator::batchWidth ( ) {
+	if ( b->precision == DOUBLEDOUBLE_PRECISION ) return laneWidthDeep;
+	return b->precision == FLOAT_PRECISION ? laneWidthFloat : laneWidth;
+}
+
+// evaluates n points together with the kernel for the actual precision, in the deep zoom the
+// points are offsets from the center. The sequences are not saved. The points known to be
+// periodic are taken away before, the kernel sees only the others.
+void BuddhaGenerator::evaluateBatch ( const double* re, const double* im, int n, LaneResult* result ) {
+	double kept[2][BATCH_MAX];
+	int index[BATCH_MAX], m = 0;
+	// the batches bigger than the buffers are not filtered
+	bool filter = n <= BATCH_MAX && !b->bounded && b->precision != DOUBLEDOUBLE_PRECISION;
+
+	if ( filter ) {
+		for ( int k = 0; k < n; ++k ) {
+			if ( knownPeriodic( re[k], im[k] ) ) {
+				result[k].max = -1;
+				result[k].contribute = result[k].calculated = 0;
+				result[k].centerDistance = 64.0;
+				continue;
+			}
+			kept[0][m] = re[k];
+			kept[1][m] = im[k];
+			index[m++] = k;
+		}
+		// nothing taken away, the results go directly in place
+		if ( m == n ) filter = false;
+	}
+
+	const double* kre = filter ? kept[0] : re;
+	const double* kim = filter ? kept[1] : im;
+	LaneResult keptResult[BATCH_MAX];
+	LaneResult* kresult = filter ? keptResult : result;
+	const int kn = filter ? m : n;
+
+	if ( kn > 0 ) {
+		if ( b->precision == DOUBLEDOUBLE_PRECISION ) evaluateDeep( deepView( ), kre, kim, kn, kresult );
+		else if ( b->precision == FLOAT_PRECISION ) evaluateLanesFloat( kernelView( ), kre, kim, kn, kresult );
+		else evaluateLanes( kernelView( ), kre, kim, kn, kresult );
+	}
+	if ( filter )
+		for ( int k = 0; k < m; ++k ) result[index[k]] = keptResult[k];
+
+	for ( int k = 0; k < n; ++k ) {
+		countPeriodicity( result[k].max, result[k].calculated );
+		learnPeriodicity( re[k], im[k], result[k].max, result[k].calculated );
+	}
+}
+
+
+// computes the rows of the importance map that nobody has taken yet. The deep zoom doesn't
+// use the map, its cells are much bigger than the window.
+void BuddhaGenerator::buildImportance ( ) {
+	double re[IMPORTANCE_SIZE], im[IMPORTANCE_SIZE], weight[IMPORTANCE_SIZE];
+	LaneResult result[IMPORTANCE_SIZE];
+	// the distances are squared, a pixel too
+	const double pixel = 1.0 / ( b->scale * b->scale );
+	int row;
+
+	if ( b->precision == DOUBLEDOUBLE_PRECISION || b->reproducible ) return;
+	// one row at a time, so a pause doesn't wait for the whole map
+	while ( status == RUN && b->importance.nextRow( row ) ) {
+		for ( int x = 0; x < IMPORTANCE_SIZE; ++x ) {
+			re[x] = ImportanceMap::cellRe( x );
+			im[x] = ImportanceMap::cellIm( row );
+		}
+		evaluateBatch( re, im, IMPORTANCE_SIZE, result );
+
+		// the orbits in the window are the best, then the ones that pass near it
+		for ( int x = 0; x < IMPORTANCE_SIZE; ++x )
+			weight[x] = result[x].max == -1 ? 0.0 : ( 1.0 + result[x].contribute ) / ( result[x].centerDistance + pixel );
+		b->importance.setRow( row, weight );
+	}
+}
+
+
+// The exterior distance estimate (Milnor): the orbit is computed with its derivative dz with
+// c until |z| is big, then d = |z| log |z| / |dz|. The boundary of the set is about at this
+// distance (between d / 4 and 2 d), and direction is the unit vector toward it, against the
+// gradient of the potential log |z|, that is conj( dz / z ).
+// Gives back 0 if the orbit doesn't escape before high, or if F is not conformal.
+template <class F>
+double BuddhaGenerator::distanceEstimate ( const complex<double>& c, complex<double>& direction ) {
+	if ( !F::conformal ) return 0.0;
+	double zr = 0.0, zi = 0.0, dr = 0.0, di = 0.0;
+
+	for ( unsigned int i = 0; i < b->high; ++i ) {
+		F::derivative( zr, zi, dr, di );
+		F::template step< ScalarLane<double> >( zr, zi, zr * zr, zi * zi, c.real(), c.imag() );
+
+		const double modulus = zr * zr + zi * zi;
+		if ( modulus > DISTANCE_BAILOUT ) {
+			const double derivative = dr * dr + di * di;
+			if ( derivative == 0.0 ) return 0.0;
+			direction = -complex<double>( dr, -di ) * complex<double>( zr, zi );
+			direction /= abs( direction );
+			return 0.5 * sqrt( modulus / derivative ) * log( modulus );
+		}
+	}
+
+	return 0.0;
+}
+
+// the distance estimate for the formula of the Buddha, 0 when it can't be done: for the
+// formulas that are not conformal, in the deep zoom and in the anti-buddhabrot, where
+// the orbits that are drawn are not outside
+double BuddhaGenerator::boundaryDistance ( const complex<double>& c, complex<double>& direction ) {
+	if ( !b->boundaryGuided || b->bounded || b->precision == DOUBLEDOUBLE_PRECISION ) return 0.0;
+
+	switch ( b->formula ) {
+	case MULTIBROT3_FORMULA: return distanceEstimate<Multibrot3Formula>( c, direction );
+	case BURNINGSHIP_FORMULA: return distanceEstimate<BurningShipFormula>( c, direction );
+	default: return distanceEstimate<MandelbrotFormula>( c, direction );
+	}
+}
+
+
 // search for a point that falls in the screen, simply moves randomly making moves
 // proportional in size to the distance from the center of the screen.
-// I think can be optimized a lot
-int BuddhaGenerator::findPoint ( complex<double>& begin, double& centerDistance, unsigned int& contribute, unsigned int& calculated ) {
-	int max, iterations = 0;
-	unsigned int calculatedInThisIteration;
-	double bestDistance = 64.0;
-	complex<double> tmp = begin;
+// At every step laneWidth mutations of the best point are evaluated together by the
+// vectorized kernel, and the best of them is kept. The sequence is not needed here.
+// When the importance map is ready the first points are taken from it instead of
+// around the origin. If hint is true begin is evaluated too, as a first guess.
+// When the best point escapes, half of its mutations are steps toward the boundary of
+// the set, of a random fraction of its distance estimate: the long orbits start there,
+// the short ones far from it add almost nothing.
+// In the deep zoom begin is an offset from the center of the window.
+int BuddhaGenerator::findPoint ( complex<double>& begin, double& centerDistance, unsigned int& contribute, unsigned int& calculated,
+				 bool hint ) {
+	int max = -1, iterations = 0;
+	double bestDistance = 64.0, boundary = 0.0;
+	double re[MAXLANES], im[MAXLANES];
+	LaneResult result[MAXLANES];
+	complex<double> toward;
+	const int lanes = batchWidth( );
+
+	buildImportance( );
+	const bool seeded = b->precision != DOUBLEDOUBLE_PRECISION && !b->reproducible && b->importance.ready( );
 
 	// 64 - 512
     #define FINDPOINTMAX 	256
 	
 	calculated = 0;
+	centerDistance = 64.0;
+	contribute = 0;
 	do {
-		//seq[0].mutate( 0.25 * sqrt(dist), &buf );
-		gaussianMutation( tmp, 0.25 * sqrt( bestDistance ) );
-		
-		max = evaluate( tmp, centerDistance, contribute, calculatedInThisIteration );
-		calculated += calculatedInThisIteration;
-
-		if ( max != -1 && centerDistance < bestDistance ) {
-			bestDistance = centerDistance;
-			begin = tmp;
-                    } else {
-                        tmp = begin;
-                    }
-        } while ( bestDistance != 0.0 && ++iterations < FINDPOINTMAX );
+		for ( int k = 0; k < lanes; ++k ) {
+			if ( hint && iterations == 0 && k == 0 ) {
+				re[k] = begin.real();
+				im[k] = begin.imag();
+				continue;
+			}
+			if ( seeded && iterations == 0 ) {
+				b->importance.sample( generator, re[k], im[k] );
+				continue;
+			}
+			complex<double> tmp = begin;
+			if ( boundary > 0.0 && ( k & 1 ) ) {
+				tmp += toward * ( generator.real() * boundary );
+				gaussianMutation( tmp, 0.25 * boundary );
+			} else {
+				gaussianMutation( tmp, 0.25 * sqrt( bestDistance ) );
+			}
+			re[k] = tmp.real();
+			im[k] = tmp.imag();
+		}
+
+		evaluateBatch( re, im, lanes, result );
+
+		bool moved = false;
+		for ( int k = 0; k < lanes; ++k ) {
+			calculated += result[k].calculated;
+
+			if ( result[k].max != -1 && result[k].centerDistance < bestDistance ) {
+				bestDistance = result[k].centerDistance;
+				begin = complex<double>( re[k], im[k] );
+				max = result[k].max;
+				centerDistance = result[k].centerDistance;
+				contribute = result[k].contribute;
+				moved = true;
+			}
+		}
+		if ( moved && bestDistance != 0.0 ) boundary = boundaryDistance( begin, toward );
+	} while ( bestDistance != 0.0 && ++iterations < FINDPOINTMAX );
 	
 	
 	return max;
 }
 
 
+// the first point of a chain. Some times it's taken from the seeds of the other chains: when
+// the seed is of this view its contribute and max are still good, otherwise the search
+// starts from it. Gives back the max of the point, contribute is 0 if nothing was found.
+int BuddhaGenerator::startChain ( complex<double>& begin, unsigned int& contribute, unsigned int& calculated ) {
+	double re, im, distance;
+	int max;
+	bool fresh = false;
+	const bool pooled = generator.real() < SEEDPOOL_REUSE && !b->reproducible && b->seeds.sample( generator, re, im, contribute, max, fresh );
+
+	calculated = 0;
+	if ( pooled ) begin = complex<double>( re, im );
+	if ( pooled && fresh && contribute > 0 ) return max;
+	return findPoint( begin, distance, contribute, calculated, pooled );
+}
+
+
+// the weight of an orbit for the metropolis, the same used for alpha
+static inline double orbitWeight ( int max, unsigned int contribute ) {
+	return max > 0 && contribute > 0 ? (double) max * max * contribute : 0.0;
+}
+
+// draws an orbit computing it again, with the precision of the evaluation
+template <class F>
+void BuddhaGenerator::drawProposal ( complex<double>& begin, int max ) {
+	if ( b->precision == DOUBLEDOUBLE_PRECISION ) drawDeepOrbit( begin, max );
+	else if ( b->precision == FLOAT_PRECISION ) drawOrbit<float, F>( begin, max );
+	else drawOrbit<double, F>( begin, max );
+}
+
+
+// one step of the multiple-try metropolis (Liu, Liang and Wong). tries mutations of ok are
+// evaluated together by the vectorized kernel and one of them is chosen with probability
+// proportional to its weight (the mutations are symmetric, so the weight is simply the one
+// of alpha). Then tries - 1 mutations of the chosen point are evaluated as well and the
+// chosen point is accepted with probability
+//	( sum of the weights of the tries ) / ( sum of the weights of the new mutations and of ok ).
+// Like in metropolis() all the tries that contribute are drawn, accepted or not.
+// Gives back the number of iterations done.
+template <class F>
+unsigned int BuddhaGenerator::multipleTry ( complex<double>& ok, int& selectedOrbitMax,
+					    unsigned int& selectedOrbitCount, RadiusController& radius, int tries ) {
+	double re[2 * MAXLANES], im[2 * MAXLANES], weight[MAXLANES];
+	LaneResult result[2 * MAXLANES];
+	double sum = 0.0, referenceSum = orbitWeight( selectedOrbitMax, selectedOrbitCount );
+	unsigned int total = 0;
+	int chosen;
+
+	for ( int k = 0; k < tries; ++k ) {
+		complex<double> tmp = ok;
+		exponentialMutation( tmp, generator.real() * radius.radius( ) );
+		re[k] = tmp.real();
+		im[k] = tmp.imag();
+	}
+	evaluateBatch( re, im, tries, result );
+
+	for ( int k = 0; k < tries; ++k ) {
+		total += result[k].calculated;
+		weight[k] = orbitWeight( result[k].max, result[k].contribute );
+		sum += weight[k];
+	}
+	// no try is periodic and contributes, nothing to do
+	if ( sum == 0.0 ) {
+		radius.update( false, false );
+		return total;
+	}
+
+	// the roundings can leave us on a try with no weight, there is one before it
+	double u = generator.real() * sum;
+	for ( chosen = 0; chosen < tries - 1 && u >= weight[chosen]; ++chosen ) u -= weight[chosen];
+	while ( weight[chosen] == 0.0 ) --chosen;
+
+	complex<double> y( re[chosen], im[chosen] );
+	for ( int k = 0; k < tries - 1; ++k ) {
+		complex<double> tmp = y;
+		exponentialMutation( tmp, generator.real() * radius.radius( ) );
+		re[tries + k] = tmp.real();
+		im[tries + k] = tmp.imag();
+	}
+	evaluateBatch( re + tries, im + tries, tries - 1, result + tries );
+	for ( int k = tries; k < 2 * tries - 1; ++k ) {
+		total += result[k].calculated;
+		referenceSum += orbitWeight( result[k].max, result[k].contribute );
+	}
+
+	QMutexLocker locker( &mutex );
+	for ( int k = 0; k < tries; ++k ) {
+		if ( weight[k] == 0.0 ) continue;
+		complex<double> begin( re[k], im[k] );
+		drawProposal<F>( begin, result[k].max );
+	}
+	locker.unlock( );
+
+	const bool accepted = sum > generator.real() * referenceSum;
+	if ( accepted ) {
+		ok = y;
+		selectedOrbitMax = result[chosen].max;
+		selectedOrbitCount = result[chosen].contribute;
+	}
+	radius.update( true, accepted );
+
+	return total;
+}
+
+
+// metropolis() with many independent chains. At every step each chain makes its mutation and
+// all the proposals are evaluated together by the vectorized kernel, so the orbits of the
+// chains are computed at the same time instead of one after the other. Every chain has its
+// own point, its own number of steps (the same of metropolis()) and accepts with the same
+// alpha. The proposals are drawn computing them again. Returns like metropolis().
+template <class F, class A>
+int BuddhaGenerator::multipleChains ( int chains ) {
+	complex<double> ok[MAXLANES];
+	RadiusController radius[MAXLANES];
+	int selectedOrbitMax[MAXLANES], steps[MAXLANES];
+	unsigned int selectedOrbitCount[MAXLANES];
+	double re[MAXLANES], im[MAXLANES], correction[MAXLANES];
+	bool large[MAXLANES];
+	LaneResult result[MAXLANES];
+	unsigned int calculated, total = 0;
+	int n = 0;
+
+	// every chain starts from its own point, the ones where the search failed are dropped
+	for ( int k = 0; k < chains; ++k ) {
+		complex<double> begin( 0.0, 0.0 );
+		selectedOrbitMax[n] = startChain( begin, selectedOrbitCount[n], calculated );
+		total += calculated;
+		if ( selectedOrbitCount[n] == 0 ) continue;
+		ok[n] = begin;
+		radius[n].start( 40.0 / b->scale, radiusScale );
+		steps[n++] = 0;
+	}
+
+	while ( n > 0 ) {
+		QMutexLocker locker( &mutex );
+		if ( !flow( ) ) return -1;
+		locker.unlock();
+		if ( b->formula != (Formula) F::formula || b->bounded == (bool) A::escaping ) return total;
+
+		for ( int k = 0; k < n; ++k ) {
+			complex<double> begin;
+			correction[k] = propose( ok[k], begin, radius[k].radius( ), large[k] );
+			re[k] = begin.real();
+			im[k] = begin.imag();
+		}
+		evaluateBatch( re, im, n, result );
+
+		locker.relock();
+		for ( int k = 0; k < n; ++k ) {
+			total += result[k].calculated;
+			if ( result[k].max <= 0 || result[k].contribute == 0 ) {
+				if ( !large[k] ) radius[k].update( false, false );
+				continue;
+			}
+
+			double alpha = (double) result[k].max * result[k].max * result[k].contribute /
+				       ( (double) selectedOrbitMax[k] * selectedOrbitMax[k] * selectedOrbitCount[k] ) * correction[k];
+			complex<double> begin( re[k], im[k] );
+			const bool accepted = alpha > generator.real();
+			if ( accepted ) {
+				ok[k] = begin;
+				selectedOrbitMax[k] = result[k].max;
+				selectedOrbitCount[k] = result[k].contribute;
+			}
+			if ( !large[k] ) radius[k].update( true, accepted );
+			drawProposal<F>( begin, result[k].max );
+		}
+		locker.unlock();
+
+		// the chains that made all their steps are replaced by the last one
+		for ( int k = 0; k < n; ) {
+			if ( ++steps[k] < max( (int) selectedOrbitCount[k] * 256, selectedOrbitMax[k] * 2 ) ) {
+				++k;
+				continue;
+			}
+			b->seeds.publish( ok[k].real(), ok[k].imag(), selectedOrbitCount[k], selectedOrbitMax[k] );
+			radiusScale = radius[k].scale;
+			--n;
+			ok[k] = ok[n];
+			radius[k] = radius[n];
+			selectedOrbitMax[k] = selectedOrbitMax[n];
+			selectedOrbitCount[k] = selectedOrbitCount[n];
+			steps[k] = steps[n] - 1;
+		}
+	}
+
+	return total;
+}
+
+
+// The quasi-random sampling: the points are taken from the scrambled Halton sequence of the
+// Buddha over the square of the importance map, where all the orbits that can be drawn start.
+// With a symmetric formula only the upper half is needed, the lower one is drawn by the
+// conjugates. The sampling is uniform so every orbit that contributes is drawn once, without
+// weights. At low zoom this converges faster than the metropolis, whose chains are correlated
+// and leave blotches in the first minutes. Called by metropolis(), returns like it.
+template <class F, class A>
+int BuddhaGenerator::quasiRandom ( ) {
+	double re[QUASIRANDOM_BLOCK], im[QUASIRANDOM_BLOCK];
+	LaneResult result[QUASIRANDOM_BLOCK];
+	const double side = IMPORTANCE_MAX - IMPORTANCE_MIN;
+	const double bottom = F::symmetric ? 0.0 : IMPORTANCE_MIN;
+	const double height = IMPORTANCE_MAX - bottom;
+	unsigned int total = 0;
+
+	for ( int j = 0; j < QUASIRANDOM_STEPS; ++j ) {
+		QMutexLocker locker( &mutex );
+		if ( !flow( ) ) return -1;
+		locker.unlock();
+		if ( b->formula != (Formula) F::formula || b->bounded == (bool) A::escaping || !b->quasiRandomSampling( ) ) return total;
+
+		const quint64 first = b->quasiRandom.next( QUASIRANDOM_BLOCK );
+		for ( int k = 0; k < QUASIRANDOM_BLOCK; ++k ) {
+			b->quasiRandom.point( first + k, re[k], im[k] );
+			re[k] = IMPORTANCE_MIN + re[k] * side;
+			im[k] = bottom + im[k] * height;
+		}
+		evaluateBatch( re, im, QUASIRANDOM_BLOCK, result );
+
+		locker.relock();
+		for ( int k = 0; k < QUASIRANDOM_BLOCK; ++k ) {
+			total += result[k].calculated;
+			if ( result[k].max <= 0 || result[k].contribute == 0 ) continue;
+			complex<double> begin( re[k], im[k] );
+			drawProposal<F>( begin, result[k].max );
+		}
+	}
+
+	return total;
+}
+
+
 // the metropolis algorithm. I don't know very much about the teory under this optimization but I think is
 // implemented quite well.. Maybe a better method for the transition probability can be found but I don't know.
+// F and A are the formula and the orbits of the Buddha, when they change I exit and run() calls
+// the right instance.
+template <class F, class A>
 int BuddhaGenerator::metropolis ( ) {
 	complex<double> begin( 0.0, 0.0 );
 	unsigned int calculated, total = 0, selectedOrbitCount = 0, proposedOrbitCount = 0;
 	int selectedOrbitMax = 0, proposedOrbitMax = 0, j;
-	double radius = 40.0 / b->scale; // 100.0;
+	RadiusController radius;
+	bool large;
 
 	//double add = 0.0; // 5.0 / b->scale;
 	double distance;
 
+	if ( b->quasiRandomSampling( ) ) return quasiRandom<F, A>( );
+
+	// many chains together, 0 chains are as many as the lanes of the kernel
+	const int chains = b->chains == 0 ? batchWidth( ) : (int) b->chains;
+	if ( chains > 1 ) return multipleChains<F, A>( chains );
+
 	// search a point that has some contribute in the interested area
-	selectedOrbitMax = findPoint( begin, distance, selectedOrbitCount, calculated );
+	selectedOrbitMax = startChain( begin, selectedOrbitCount, calculated );
 
         //cout << selectedOrbitMax << endl;
 
@@ -292,6 +995,9 @@ int BuddhaGenerator::metropolis ( ) {
 	if ( selectedOrbitCount == 0 ) return calculated;
 	
 	complex<double> ok = begin;
+	radius.start( 40.0 / b->scale, radiusScale ); // 100.0;
+	// the multiple-try mode, 0 tries are as many as the lanes of the kernel
+	const int tries = b->tries == 0 ? batchWidth( ) : (int) b->tries;
 	// also "how much" cicles are executed on each point is crucial. In order to have more points on the
 	// screen an high iteration count could be better but, not too high because otherwise the space
 	// is not sampled well. I tried values between 512 and 8192 and they works well. Over 80000 it becames strange.
@@ -303,48 +1009,64 @@ int BuddhaGenerator::metropolis ( ) {
 		QMutexLocker locker( &mutex );
 		if ( !flow( ) ) return -1;
 		locker.unlock();
+		if ( b->formula != (Formula) F::formula || b->bounded == (bool) A::escaping ) return total;
+
+		if ( tries > 1 ) {
+			total += multipleTry<F>( ok, selectedOrbitMax, selectedOrbitCount, radius, tries );
+			continue;
+		}
 
 		begin = ok;
 		// the radius of the mutations influences a lot the quality of the rendering AND the speed.
 		// I think that choose a random radius is the best way otherwise I noticed some geometric artifacts
 		// around the point (-1.8, 0) for example. This artifacts however depend also on the number of iterations
-		// explained above.
+		// explained above. The random radius is still there, but its scale follows the acceptance
+		// (see RadiusController), at deep zoom 40 pixels are often too much.
 
+		// Some times the proposal is a large step instead, see propose().
 		//seq[0].mutate( random( &buf ) * radius /* + add */, &buf );
-		exponentialMutation( begin, generator.real() * radius );
+		const double correction = propose( ok, begin, radius.radius( ), large );
 		
 		// calculate the new sequence
-		proposedOrbitMax = evaluate( begin, distance, proposedOrbitCount, calculated );
-		
-		// the sequence is periodic, I try another mutation
-		if ( proposedOrbitMax <= 0 ) continue;
+		proposedOrbitMax = evaluateProposal<F, A>( begin, distance, proposedOrbitCount, calculated );
 		
-		// maybe the sequence is not periodic but It doesn't contribute on the actual region
-		if ( proposedOrbitCount == 0 ) continue;
+		// the sequence is periodic, I try another mutation. Or maybe the sequence is not
+		// periodic but It doesn't contribute on the actual region
+		if ( proposedOrbitMax <= 0 || proposedOrbitCount == 0 ) {
+			if ( !large ) radius.update( false, false );
+			continue;
+		}
 		
 		
 		// calculus of the transitional probability. One point is more probable of being
 		// chose if generates a lot of points in the window
-		double alpha =  proposedOrbitMax * proposedOrbitMax * proposedOrbitCount /
-				double( selectedOrbitMax * selectedOrbitMax * selectedOrbitCount );
+		// (in double, with the long orbits of the two pass mode the integers overflow)
+		double alpha =  (double) proposedOrbitMax * proposedOrbitMax * proposedOrbitCount /
+				( (double) selectedOrbitMax * selectedOrbitMax * selectedOrbitCount ) * correction;
 
 		
-		if ( alpha > generator.real() ) {
+		const bool accepted = alpha > generator.real();
+		if ( accepted ) {
 			ok = begin;
 			selectedOrbitCount = proposedOrbitCount;
 			selectedOrbitMax = proposedOrbitMax;
 		}
+		if ( !large ) radius.update( true, accepted );
 		
 		total += calculated;
 
 		locker.relock();
 		// draw the points
-		for ( int h = 0; h <= proposedOrbitMax - (int) b->low && proposedOrbitCount > 0; h++ ) {
-			unsigned int i = h + b->low;
-			drawPoint( seq[h], i < b->highr && i > b->lowr, i < b->highg && i > b->lowg, i < b->highb && i > b->lowb);
+		if ( b->twoPass ) {
+			drawProposal<F>( begin, proposedOrbitMax );
+		} else if ( proposedOrbitCount > 0 && proposedOrbitMax >= (int) b->low ) {
+			drawPoints( &seq[0], proposedOrbitMax - b->low + 1, b->low );
 		}
 	}
 
+	// the other chains can start from here, and from this radius
+	b->seeds.publish( ok.real(), ok.imag(), selectedOrbitCount, selectedOrbitMax );
+	radiusScale = radius.scale;
 	return total;
 }
 
@@ -355,7 +1077,20 @@ void BuddhaGenerator::run ( ) {
 	int exit = 0;
 	
 	do {
-		exit = metropolis( );
+		// the formula is chosen here once for every call of metropolis(), not for every point
+		switch ( b->formula ) {
+		case MULTIBROT3_FORMULA:
+			exit = b->bounded ? metropolis<Multibrot3Formula, BoundedOrbits>( ) :
+					    metropolis<Multibrot3Formula, EscapingOrbits>( );
+			break;
+		case BURNINGSHIP_FORMULA:
+			exit = b->bounded ? metropolis<BurningShipFormula, BoundedOrbits>( ) :
+					    metropolis<BurningShipFormula, EscapingOrbits>( );
+			break;
+		default:
+			exit = b->bounded ? metropolis<MandelbrotFormula, BoundedOrbits>( ) :
+					    metropolis<MandelbrotFormula, EscapingOrbits>( );
+		}
 
 		QMutexLocker locker( &mutex );
 		if ( !flow( ) ) exit = -1;
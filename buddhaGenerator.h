@@ -43,38 +43,141 @@
 #include <iostream>
 #include "buddha.h"
 #include "random.h"
+#include "simdKernel.h"
 using namespace std;
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
 
+// the orbits are drawn in pieces of at most this number of points
+#define DRAWCHUNK	1024
+// and the deep orbits are computed in pieces of this number of points
+#define DEEPCHUNK	256
+
+// the mutation radius of the metropolis is 40 pixels multiplied by a scale that goes toward
+// this acceptance ratio, between RADIUS_MIN and RADIUS_MAX. RADIUS_GAIN is how fast it moves.
+#define TARGET_ACCEPTANCE	0.25
+#define RADIUS_MIN		( 1.0 / 64.0 )
+#define RADIUS_MAX		4.0
+#define RADIUS_GAIN		0.02
+// the radius doesn't grow when less than this fraction of the proposals contributes
+#define RADIUS_CONTRIBUTION	0.5
+
+// probability of a large step of the metropolis, a proposal that doesn't depend on the
+// actual point (Kelemen), see BuddhaGenerator::propose()
+#define LARGESTEP_PROBABILITY	0.1
+
+// the biggest batch of evaluateBatch() that is filtered with the PeriodicCache, the rows of
+// the importance map and the blocks of the quasi-random sampling are not bigger
+#define BATCH_MAX	256
+
+// the squared modulus where the orbits of the distance estimate stop, the estimate is good
+// only when z is far from the set
+#define DISTANCE_BAILOUT	1.0e6
+
+// QUASIRANDOM_STEPS is how many blocks every call of quasiRandom() evaluates, each one of
+// QUASIRANDOM_BLOCK points (see quasiRandom.h)
+#define QUASIRANDOM_STEPS	64
+
+
+
+// The controller of the mutation radius of a chain. The scale is moved on the logarithmic scale,
+// up when a proposal is accepted and down when it's not, so it stays where the acceptance is
+// TARGET_ACCEPTANCE (Robbins-Monro). It grows only if the proposals contribute enough.
+struct RadiusController {
+	double base, scale;
+	double contribution;	// running average of the proposals that contribute
+
+	void start ( double b, double s ) {
+		base = b;
+		scale = s;
+		contribution = 1.0;
+	}
+
+	double radius ( ) const { return base * scale; }
+
+	void update ( bool contributed, bool accepted ) {
+		static const double up = exp( RADIUS_GAIN * ( 1.0 - TARGET_ACCEPTANCE ) );
+		static const double down = exp( -RADIUS_GAIN * TARGET_ACCEPTANCE );
+		contribution += RADIUS_GAIN * ( contributed - contribution );
+
+		if ( !accepted ) scale = max( scale * down, RADIUS_MIN );
+		else if ( contribution >= RADIUS_CONTRIBUTION ) scale = min( scale * up, RADIUS_MAX );
+	}
+};
 
 
 class BuddhaGenerator : public QThread {
 public:	
 	// general data and utility functions
 	Buddha* b;
-	BuddhaGenerator( )   { raw = NULL; }
-	~BuddhaGenerator( )  { delete[] raw; }
+	BuddhaGenerator( )   { radiusScale = 1.0; memset( periodicityStats, 0, sizeof( periodicityStats ) ); }
 
-	void initialize ( Buddha* b );
+	void initialize ( Buddha* b, int index );
 
-	// for the raw image and the sequence of points
+	// for the sequence of points and the histogram of the Buddha
 	vector<complex<double>> seq;
-	unsigned int* raw;
+	SplatBuffer splats;	// the points not yet sorted, see SplatBuffer
+	TileCache tiles;	// the counts not yet in the histogram, see Buddha::histogramStrategy
 	
-	void drawPoint ( complex<double>& c, bool r, bool g, bool b );
-	int inside ( complex<double>& c );
+	inline void splat ( unsigned int pixel, unsigned int mask ) {
+		if ( splats.add( pixel, mask ) ) flushSplats( );
+	}
+	void flushSplats ( );
+	template <class T> void drawPoint ( complex<T>& c, bool r, bool g, bool b );
+	template <class F, class T> int inside ( complex<T>& c );
+	// F is the formula and A the orbits that are drawn, see formula.h
+	template <class T, bool saveSequence, class F, class A>
 	int evaluate ( complex<double>& begin, double& distance, unsigned int& contribute, unsigned int& calculated );
-	int findPoint ( complex<double>& begin, double& centerDistance, unsigned int& contribute, unsigned int& calculated );
-	int metropolis();
+	template <class F, class A>
+	int evaluateProposal ( complex<double>& begin, double& distance, unsigned int& contribute, unsigned int& calculated );
+	template <class T, class F> void drawOrbit ( complex<double>& begin, int max );
+	template <class F> void drawProposal ( complex<double>& begin, int max );
+	void drawPoints ( const complex<double>* points, int n, unsigned int first );
+
+	// statistics of the periodicity check, one for every strategy
+	PeriodicityStats periodicityStats[PERIODICITY_STRATEGIES];
+	void countPeriodicity ( int max, unsigned int calculated );
+	bool knownPeriodic ( double re, double im );
+	void learnPeriodicity ( double re, double im, int max, unsigned int calculated );
+
+	// for the deep zoom the points are offsets from the center of the window, see DeepView
+	void drawDeepPoint ( double re, double im, double conjim, bool r, bool g, bool b );
+	void drawDeepOrbit ( complex<double>& begin, int max );
+
+	// the vectorized kernels for many points together, chosen by selectKernels() for
+	// the formula of the Buddha
+	EvaluateLanesFunction evaluateLanes, evaluateLanesFloat;
+	EvaluateDeepFunction evaluateDeep, evaluateDeepScalar;
+	int laneWidth, laneWidthFloat, laneWidthDeep;
+	ProjectPointsFunction projectPoints;
+	void selectKernels ( );
+	KernelView kernelView ( );
+	DeepView deepView ( );
+	ProjectView projectView ( );
+	int batchWidth ( );
+	void evaluateBatch ( const double* re, const double* im, int n, LaneResult* result );
+	void buildImportance ( );
+	template <class F> double distanceEstimate ( const complex<double>& c, complex<double>& direction );
+	double boundaryDistance ( const complex<double>& c, complex<double>& direction );
+	int findPoint ( complex<double>& begin, double& centerDistance, unsigned int& contribute, unsigned int& calculated,
+			bool hint = false );
+	int startChain ( complex<double>& begin, unsigned int& contribute, unsigned int& calculated );
+	template <class F> unsigned int multipleTry ( complex<double>& ok, int& selectedOrbitMax,
+						      unsigned int& selectedOrbitCount, RadiusController& radius, int tries );
+	template <class F, class A> int multipleChains ( int chains );
+	template <class F, class A> int metropolis ( );
+	template <class F, class A> int quasiRandom ( );
 	
 	// things for the random stuff
-	unsigned long int seed;
+	int index;		// the substream of the run seed, see Buddha::runSeed
 	Random generator;
 	
+	double radiusScale;	// the scale where the last chain arrived, the next ones start from there
 	void gaussianMutation ( complex<double>& z, double radius );
+	double propose ( const complex<double>& ok, complex<double>& proposal, double radius, bool& large );
+	double largeStepDensity ( const complex<double>& c );
 	void exponentialMutation ( complex<double>& z, double radius );
 	
 	// for the synchronization and for controlling the execution
@@ -26,6 +26,7 @@
 */
 
 #include "controlWindow.h"
+#include "simdKernel.h"
 #include <QtWidgets/QVBoxLayout>
 #include <QtWidgets/QShortcut>
 #include <QtWidgets/QMessageBox>
@@ -60,6 +61,7 @@ ControlWindow::ControlWindow() {
 
 	// Default parmaters, set here because data member initialization isn't allowed in .h
     cre = cim = 0.0;
+	creLo = cimLo = 0.0;
     lowr = 50;
     highr = 100;
     lowg = 75;
@@ -72,13 +74,15 @@ ControlWindow::ControlWindow() {
     minIm = -1.3;
     maxIm = 1.3;
 	minScale = 100; //should start at 1, not 100 as the contrast/lightness
-	maxScale = 1.34217728E+8 * 128.0;
+	// with the double-double arithmetic the zoom can go far beyond the double precision
+	maxScale = 1.0E+28;
 	step = 0.001;
 
 	// Create Controls
 	centralWidget = new QWidget( this );
 	createGraphBox();
 	createRenderBox();
+	createSamplingBox();
 	createControlBox();
 	createMenus();
 	
@@ -86,6 +90,7 @@ ControlWindow::ControlWindow() {
 	QHBoxLayout *hbox = new QHBoxLayout( );
 	QVBoxLayout *vbox = new QVBoxLayout( );
 	vbox->addWidget( renderBox );
+	vbox->addWidget( samplingBox );
 	vbox->addWidget( buttonsBox );
 	hbox->addWidget( graphBox );
 	hbox->addLayout( vbox );
@@ -114,6 +119,7 @@ ControlWindow::ControlWindow() {
 	connect( contrastSlider, SIGNAL( valueChanged( int ) ), this, SLOT( setContrast( int ) ) );
 	connect( fpsSlider, SIGNAL( valueChanged( int ) ), this, SLOT( setFps( int ) ) );
 	connect( threadsSlider, SIGNAL( valueChanged( int ) ), this, SLOT( setThreadNum( int ) ) );
+	connect( histogramBox, SIGNAL( currentIndexChanged( int ) ), b, SLOT( setHistogramStrategy( int ) ) );
 
 	// Buttons
 	connect( startButton, SIGNAL( clicked() ), this, SLOT(handleStartButton()));
@@ -126,8 +132,8 @@ ControlWindow::ControlWindow() {
 	connect( new QShortcut( screenShotAct->shortcut(), renderWin ), SIGNAL(activated()), this, SLOT(saveScreenshot()) );
 	
 	// Uglyyyyyy
-    connect( this, SIGNAL( setValues( double, double, double, unsigned int, unsigned int, unsigned int, unsigned int, unsigned int, unsigned int, QSize, bool ) ),
-                 b, SLOT( set( double, double, double, unsigned int, unsigned int, unsigned int, unsigned int, unsigned int, unsigned int, QSize, bool ) ) );
+    connect( this, SIGNAL( setValues( double, double, double, double, double, unsigned int, unsigned int, unsigned int, unsigned int, unsigned int, unsigned int, QSize, bool ) ),
+                 b, SLOT( set( double, double, double, double, double, unsigned int, unsigned int, unsigned int, unsigned int, unsigned int, unsigned int, QSize, bool ) ) );
 
 	// Internal
 	connect( this, SIGNAL( startCalculation( ) ), b, SLOT( startGenerators( ) ) );
@@ -135,6 +141,18 @@ ControlWindow::ControlWindow() {
 	connect( this, SIGNAL( pauseCalculation( ) ), b, SLOT( pauseGenerators( ) ) );
 	connect( this, SIGNAL( clearBuffers( ) ), b, SLOT( clearBuffers( ) ) );
 	connect( this, SIGNAL( changeThreadNumber( int ) ), b, SLOT( changeThreadNumber( int ) ) );
+	connect( this, SIGNAL( setFractal( int, bool ) ), b, SLOT( setFractal( int, bool ) ) );
+	connect( formulaBox, SIGNAL( currentIndexChanged( int ) ), this, SLOT( sendFractal( ) ) );
+	connect( boundedBox, SIGNAL( toggled( bool ) ), this, SLOT( sendFractal( ) ) );
+	connect( periodicityBox, SIGNAL( currentIndexChanged( int ) ), b, SLOT( setPeriodicity( int ) ) );
+	connect( samplingMethodBox, SIGNAL( currentIndexChanged( int ) ), b, SLOT( setSampling( int ) ) );
+	connect( triesBox, SIGNAL( valueChanged( int ) ), b, SLOT( setTries( int ) ) );
+	connect( chainsBox, SIGNAL( valueChanged( int ) ), b, SLOT( setChains( int ) ) );
+	connect( this, SIGNAL( setSeed( qulonglong, int ) ), b, SLOT( setSeed( qulonglong, int ) ) );
+	connect( seedBox, SIGNAL( valueChanged( int ) ), this, SLOT( sendSeed( ) ) );
+	connect( streamBox, SIGNAL( valueChanged( int ) ), this, SLOT( sendSeed( ) ) );
+	connect( reproducibleBox, SIGNAL( toggled( bool ) ), b, SLOT( setReproducible( bool ) ) );
+	connect( boundaryBox, SIGNAL( toggled( bool ) ), b, SLOT( setBoundaryGuided( bool ) ) );
 	setThreadNum( threadsSlider->value() );
 
 	// these are for the real-time update of the values directly from the controlWindow
@@ -233,6 +251,17 @@ void ControlWindow::createGraphBox ( ) {
 	zoomBox->setAccelerated( true );
 	zoomBox->setDecimals( PRECISION / 3 );
 	zoomBox->setToolTip( "Specify the magnification level of the rendered image" );
+
+	// in the same order of the Formula enum
+	formulaLabel = new QLabel( "Fractal:", graphBox );
+	formulaBox = new QComboBox( graphBox );
+	formulaBox->addItem( "Mandelbrot (z^2 + c)" );
+	formulaBox->addItem( "Multibrot (z^3 + c)" );
+	formulaBox->addItem( "Burning Ship" );
+	formulaBox->setToolTip( "The fractal whose orbits are drawn. Only the Mandelbrot has the deep zoom" );
+
+	boundedBox = new QCheckBox( "Anti-Buddhabrot", graphBox );
+	boundedBox->setToolTip( "Draw the orbits that don't escape instead of the ones that escape" );
 	
 	
 	QVBoxLayout *vbox = new QVBoxLayout ( );
@@ -264,6 +293,9 @@ void ControlWindow::createGraphBox ( ) {
 	vbox->addWidget( imBox );
 	vbox->addWidget( zoomLabel );
 	vbox->addWidget( zoomBox );
+	vbox->addWidget( formulaLabel );
+	vbox->addWidget( formulaBox );
+	vbox->addWidget( boundedBox );
 	//vbox->addStretch(1);
     graphBox->setLayout( vbox );
 
@@ -308,6 +340,14 @@ void ControlWindow::createRenderBox ( ) {
 	threadsSlider->setOrientation(Qt::Horizontal);
     updateThreadLabel( QThread::idealThreadCount() );
     threadsSlider->setValue( QThread::idealThreadCount() );
+
+	// in the same order of the HistogramStrategy enum
+	histogramLabel = new QLabel( "Histogram writes:", renderBox );
+	histogramBox = new QComboBox( renderBox );
+	histogramBox->addItem( "Atomic" );
+	histogramBox->addItem( "Tile cache" );
+	histogramBox->setCurrentIndex( b->histogramStrategy );
+	histogramBox->setToolTip( "How the threads add their points, the tile cache is better only with many threads on the same bright pixels" );
 	
 	QVBoxLayout *vbox = new QVBoxLayout ( );
 	vbox->addWidget( contrastLabel );
@@ -318,11 +358,98 @@ void ControlWindow::createRenderBox ( ) {
 	vbox->addWidget( fpsSlider );
 	vbox->addWidget( threadsLabel );
 	vbox->addWidget( threadsSlider );
+	vbox->addWidget( histogramLabel );
+	vbox->addWidget( histogramBox );
 //	vbox->addStretch(1);
 	renderBox->setLayout( vbox );
 
 }
 
+/*
+ * Called by Constructor, the way the generators work. The initial values are the ones of Buddha
+ */
+void ControlWindow::createSamplingBox ( ) {
+	samplingBox = new QGroupBox( "Sampling", this );
+
+	// in the same order of the Sampling enum
+	samplingLabel = new QLabel( "Points:", samplingBox );
+	samplingMethodBox = new QComboBox( samplingBox );
+	samplingMethodBox->addItem( "Metropolis" );
+	samplingMethodBox->addItem( "Quasi-random" );
+	samplingMethodBox->addItem( "Automatic" );
+	samplingMethodBox->setCurrentIndex( b->sampling );
+	samplingMethodBox->setToolTip( "How the points are chosen. Automatic uses the quasi-random ones for the big windows, the deep zoom always the metropolis" );
+
+	// in the same order of the Periodicity enum
+	periodicityLabel = new QLabel( "Periodicity check:", samplingBox );
+	periodicityBox = new QComboBox( samplingBox );
+	periodicityBox->addItem( "Doubling" );
+	periodicityBox->addItem( "Brent" );
+	periodicityBox->addItem( "Adaptive tolerance" );
+	periodicityBox->setCurrentIndex( b->periodicity );
+	periodicityBox->setToolTip( "How the orbits that never escape are found, see the statistics printed at every reset" );
+
+	// 0 is shown as a word, see Buddha::setTries()
+	triesLabel = new QLabel( "Metropolis tries:", samplingBox );
+	triesBox = new QSpinBox( samplingBox );
+	triesBox->setRange( 0, MAXLANES );
+	triesBox->setAlignment( Qt::AlignCenter );
+	triesBox->setButtonSymbols( QAbstractSpinBox::PlusMinus );
+	triesBox->setSpecialValueText( "As the lanes" );
+	triesBox->setValue( b->tries );
+	triesBox->setToolTip( "Proposals evaluated together at every step of the metropolis, 1 is the classic one" );
+
+	// the same for the chains, see Buddha::setChains()
+	chainsLabel = new QLabel( "Metropolis chains:", samplingBox );
+	chainsBox = new QSpinBox( samplingBox );
+	chainsBox->setRange( 0, MAXLANES );
+	chainsBox->setAlignment( Qt::AlignCenter );
+	chainsBox->setButtonSymbols( QAbstractSpinBox::PlusMinus );
+	chainsBox->setSpecialValueText( "As the lanes" );
+	chainsBox->setValue( b->chains );
+	chainsBox->setToolTip( "Independent chains of every thread, with more than one the tries are not used" );
+
+	boundaryBox = new QCheckBox( "Search near the boundary", samplingBox );
+	boundaryBox->setChecked( b->boundaryGuided );
+	boundaryBox->setToolTip( "The search of the first point of a chain moves toward the boundary of the set, with the distance estimate" );
+
+	// the seed can be bigger in Buddha, but these are enough for choosing one
+	seedLabel = new QLabel( "Seed and stream:", samplingBox );
+	seedBox = new QSpinBox( samplingBox );
+	seedBox->setRange( 0, INT_MAX );
+	seedBox->setAlignment( Qt::AlignCenter );
+	seedBox->setButtonSymbols( QAbstractSpinBox::PlusMinus );
+	seedBox->setValue( (int) b->runSeed );
+	seedBox->setToolTip( "All the random numbers of a run come from this seed" );
+	streamBox = new QSpinBox( samplingBox );
+	streamBox->setRange( 0, INT_MAX );
+	streamBox->setAlignment( Qt::AlignCenter );
+	streamBox->setButtonSymbols( QAbstractSpinBox::PlusMinus );
+	streamBox->setValue( b->runStream );
+	streamBox->setToolTip( "The runs with the same seed and different streams never draw the same numbers, for splitting a render" );
+	reproducibleBox = new QCheckBox( "Reproducible", samplingBox );
+	reproducibleBox->setChecked( b->reproducible );
+	reproducibleBox->setToolTip( "The threads don't share what they found, so a run started with the same seed, stream and threads draws the same points" );
+
+	QVBoxLayout *vbox = new QVBoxLayout ( );
+	vbox->addWidget( samplingLabel );
+	vbox->addWidget( samplingMethodBox );
+	vbox->addWidget( periodicityLabel );
+	vbox->addWidget( periodicityBox );
+	vbox->addWidget( triesLabel );
+	vbox->addWidget( triesBox );
+	vbox->addWidget( chainsLabel );
+	vbox->addWidget( chainsBox );
+	vbox->addWidget( boundaryBox );
+	vbox->addWidget( seedLabel );
+	QHBoxLayout *seedLayout = new QHBoxLayout( );
+	seedLayout->addWidget( seedBox );
+	seedLayout->addWidget( streamBox );
+	vbox->addLayout( seedLayout );
+	vbox->addWidget( reproducibleBox );
+	samplingBox->setLayout( vbox );
+}
+
 /*
  * Called by CreateMenu
  */
@@ -432,10 +559,18 @@ void ControlWindow::createControlBox ( ) {
 void ControlWindow::sendValues ( bool pause ) {
 	if ( this->valuesChanged() ) {
 
-		emit setValues( cre, cim, scale, lowr, lowg, lowb, highr, highg, highb, renderWin->size(), pause );
+		emit setValues( cre, cim, creLo, cimLo, scale, lowr, lowg, lowb, highr, highg, highb, renderWin->size(), pause );
 	}
 }
 
+void ControlWindow::sendFractal ( ) {
+	emit setFractal( formulaBox->currentIndex( ), boundedBox->isChecked( ) );
+}
+
+void ControlWindow::sendSeed ( ) {
+	emit setSeed( (qulonglong) seedBox->value( ), streamBox->value( ) );
+}
+
 
 
 
@@ -462,7 +597,7 @@ void ControlWindow::handleResetButton ( ) {
 }
 
 bool ControlWindow::valuesChanged ( ) {
-	return  cre != b->cre || cim != b->cim || scale != b->scale ||
+	return  cre != b->cre || cim != b->cim || creLo != b->creLo || cimLo != b->cimLo || scale != b->scale ||
                 highr != b->highr || highg != b->highg || highb != b->highb ||
                 lowr != b->lowr || lowg != b->lowg || lowb != b->lowb ||
 		renderWin->width() != (int) b->w || renderWin->height() != (int) b->h;
@@ -562,20 +697,37 @@ void ControlWindow::setFps ( int value ) {
 	}
 }
 
+// the spin boxes show only PRECISION decimals, so when they give back the value that they
+// received I keep the full center, otherwise the deep zooms would be lost
 void ControlWindow::setCre ( double d ) {
+	if ( fabs( d - cre ) <= 0.5 * pow( 10.0, -PRECISION ) ) return;
 	cre = d;
+	creLo = 0.0;
 	if ( cre < minRe ) cre = minRe;
 	if ( cre > maxRe ) cre = maxRe;
 	//viewStartButton ( );
 }
 
 void ControlWindow::setCim ( double d ) {
+	if ( fabs( d - cim ) <= 0.5 * pow( 10.0, -PRECISION ) ) return;
 	cim = d;
+	cimLo = 0.0;
 	if ( cim < minIm ) cim = minIm;
 	if ( cim > maxIm ) cim = maxIm;
 	//viewStartButton ( );
 }
 
+// moves the center of the actual image, used by the render window. The sum is done in
+// double-double so the small moves of the deep zooms are not lost.
+void ControlWindow::moveCenter ( double dre, double dim ) {
+	addToDoubleDouble( b->cre, b->creLo, dre, cre, creLo );
+	addToDoubleDouble( b->cim, b->cimLo, dim, cim, cimLo );
+	if ( cre < minRe ) { cre = minRe; creLo = 0.0; }
+	if ( cre > maxRe ) { cre = maxRe; creLo = 0.0; }
+	if ( cim < minIm ) { cim = minIm; cimLo = 0.0; }
+	if ( cim > maxIm ) { cim = maxIm; cimLo = 0.0; }
+}
+
 void ControlWindow::setScale ( double d ) {
 	scale = d;
 	
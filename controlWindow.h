@@ -35,6 +35,8 @@
 #include <QtWidgets/QPushButton>
 #include <QtWidgets/QGroupBox>
 #include <QtWidgets/QDoubleSpinBox>
+#include <QtWidgets/QComboBox>
+#include <QtWidgets/QCheckBox>
 #include <QtWidgets/QLabel>
 #include <QtWidgets/QAbstractSpinBox>
 #include <QtCore/QVariant>
@@ -67,6 +69,7 @@ public:
     int contrast, lightness;
 	double fps;
     double cre, cim;
+	double creLo, cimLo;	// low part of the center for the deep zooms
 	double scale;
 	Buddha* b;
 
@@ -75,10 +78,22 @@ public:
 	QGroupBox *graphBox;
 	QGroupBox *buttonsBox;
 	QGroupBox *renderBox;
+	QGroupBox *samplingBox;
 
 	QDoubleSpinBox *reBox;
 	QDoubleSpinBox *imBox;
 	QDoubleSpinBox *zoomBox;
+	QComboBox *formulaBox;
+	QCheckBox *boundedBox;
+	QComboBox *periodicityBox;
+	QComboBox *samplingMethodBox;
+	QComboBox *histogramBox;
+	QSpinBox *triesBox;
+	QSpinBox *chainsBox;
+	QSpinBox *seedBox;
+	QSpinBox *streamBox;
+	QCheckBox *reproducibleBox;
+	QCheckBox *boundaryBox;
 
     QSpinBox *minRbox;
     QSpinBox *maxRbox;
@@ -91,6 +106,7 @@ public:
 	QLabel *reLabel;
 	QLabel *imLabel;
 	QLabel *zoomLabel;
+	QLabel *formulaLabel;
 	QLabel *iterationGreenLabel;
     QLabel *iterationBlueLabel;
 	QLabel *contrastLabel;
@@ -98,6 +114,12 @@ public:
 	QLabel *fpsLabel;
 	QLabel *threadsLabel;
 	QLabel *mouseLabel;
+	QLabel *periodicityLabel;
+	QLabel *samplingLabel;
+	QLabel *histogramLabel;
+	QLabel *triesLabel;
+	QLabel *chainsLabel;
+	QLabel *seedLabel;
 
 	QSlider *contrastSlider;
 	QSlider *lightSlider;
@@ -118,6 +140,7 @@ public:
 
 	void createGraphBox ( );
 	void createRenderBox ( );
+	void createSamplingBox ( );
 	void createControlBox ( );
 	void createMenus( );
 	void createActions( );
@@ -160,20 +183,25 @@ public slots:
 	void setButtonStop( ) { startButton->setText( tr( "&Stop" ) ); }
 	void setCre ( double d );
 	void setCim ( double d );
+	void moveCenter ( double dre, double dim );
 	void setScale ( double d );
 	void setThreadNum ( int value );
 	void about ( );
 	void saveScreenshot( );
 	void sendValues( bool pause = true );
+	void sendFractal( );
+	void sendSeed( );
 
 signals:
 	void closed ( );
-    void setValues( double cre, double cim, double scale, uint lowr, uint lowg, uint lowb, uint highr, uint highg, uint highb, QSize wsize, bool pause );
+    void setValues( double cre, double cim, double creLo, double cimLo, double scale, uint lowr, uint lowg, uint lowb, uint highr, uint highg, uint highb, QSize wsize, bool pause );
 	void startCalculation( );
 	void stopCalculation( );
 	void pauseCalculation( );
 	void clearBuffers( );
 	void changeThreadNumber( int );
+	void setFractal( int formula, bool bounded );
+	void setSeed( qulonglong seed, int stream );
 	void screenshotRequest ( QString fileName );
 
 protected:
@@ -0,0 +1,293 @@
+/*
+ * Copyright (c) 2010, Emilio Del Tessandoro
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY EMILIO DEL TESSANDORO o ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL EMILIO DEL TESSANDORO BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+
+#ifndef DOUBLEDOUBLE_H
+#define DOUBLEDOUBLE_H
+
+#include "simdKernel.h"
+
+
+// Double-double numbers: the value is hi + lo with |lo| <= ulp(hi) / 2, about 106 bits of
+// mantissa. The operations are the classic error free transformations (Knuth two-sum, Dekker
+// split and product) written with the operations of the lane types V, so the same code works
+// on one lane or on a full vector.
+// They need strict IEEE arithmetic: the files that include this header must be compiled
+// without /fp:fast or -ffast-math, and without contraction of mul and add (-ffp-contract=off).
+// Only the kernel files do it, the rest of the program sees the functions in simdKernel.h.
+
+template <class V>
+struct DD {
+	typename V::reg hi, lo;
+};
+
+template <class V>
+inline DD<V> ddSet1 ( double hi, double lo ) {
+	DD<V> r;
+	r.hi = V::set1( hi );
+	r.lo = V::set1( lo );
+	return r;
+}
+
+// a + b exactly, if |a| >= |b|
+template <class V>
+inline DD<V> quickTwoSum ( typename V::reg a, typename V::reg b ) {
+	DD<V> r;
+	r.hi = V::add( a, b );
+	r.lo = V::sub( b, V::sub( r.hi, a ) );
+	return r;
+}
+
+// a + b exactly
+template <class V>
+inline DD<V> twoSum ( typename V::reg a, typename V::reg b ) {
+	DD<V> r;
+	r.hi = V::add( a, b );
+	const typename V::reg bb = V::sub( r.hi, a );
+	r.lo = V::add( V::sub( a, V::sub( r.hi, bb ) ), V::sub( b, bb ) );
+	return r;
+}
+
+// splits a in two halves of 26 bits, so that their products are exact
+template <class V>
+inline void split ( typename V::reg a, typename V::reg& hi, typename V::reg& lo ) {
+	const typename V::reg t = V::mul( V::set1( 134217729.0 ), a );	// 2^27 + 1
+	hi = V::sub( t, V::sub( t, a ) );
+	lo = V::sub( a, hi );
+}
+
+// a * b exactly
+template <class V>
+inline DD<V> twoProduct ( typename V::reg a, typename V::reg b ) {
+	typename V::reg ahi, alo, bhi, blo;
+	DD<V> r;
+	split<V>( a, ahi, alo );
+	split<V>( b, bhi, blo );
+	r.hi = V::mul( a, b );
+	r.lo = V::add( V::add( V::add( V::sub( V::mul( ahi, bhi ), r.hi ), V::mul( ahi, blo ) ),
+	                       V::mul( alo, bhi ) ), V::mul( alo, blo ) );
+	return r;
+}
+
+template <class V>
+inline DD<V> ddAdd ( const DD<V>& a, const DD<V>& b ) {
+	DD<V> s = twoSum<V>( a.hi, b.hi );
+	const DD<V> t = twoSum<V>( a.lo, b.lo );
+	s = quickTwoSum<V>( s.hi, V::add( s.lo, t.hi ) );
+	return quickTwoSum<V>( s.hi, V::add( s.lo, t.lo ) );
+}
+
+template <class V>
+inline DD<V> ddSub ( const DD<V>& a, const DD<V>& b ) {
+	DD<V> nb;
+	nb.hi = V::sub( V::set1( 0.0 ), b.hi );
+	nb.lo = V::sub( V::set1( 0.0 ), b.lo );
+	return ddAdd<V>( a, nb );
+}
+
+template <class V>
+inline DD<V> ddMul ( const DD<V>& a, const DD<V>& b ) {
+	DD<V> p = twoProduct<V>( a.hi, b.hi );
+	p.lo = V::add( p.lo, V::add( V::mul( a.hi, b.lo ), V::mul( a.lo, b.hi ) ) );
+	return quickTwoSum<V>( p.hi, p.lo );
+}
+
+template <class V>
+inline DD<V> ddSqr ( const DD<V>& a ) {
+	DD<V> p = twoProduct<V>( a.hi, a.hi );
+	const typename V::reg cross = V::mul( a.hi, a.lo );
+	p.lo = V::add( p.lo, V::add( cross, cross ) );
+	return quickTwoSum<V>( p.hi, p.lo );
+}
+
+// multiplication by 2 is exact
+template <class V>
+inline DD<V> ddTwice ( const DD<V>& a ) {
+	DD<V> r;
+	r.hi = V::add( a.hi, a.hi );
+	r.lo = V::add( a.lo, a.lo );
+	return r;
+}
+
+
+
+// The double-double version of evaluateLanesKernel(). The points are given as offsets from the
+// center of the window (v.cre + v.creLo, v.cim + v.cimLo), that is in double-double. The orbit
+// is computed in double-double and only its distance from the center is converted to double,
+// for the window test and the center distance. See evaluateLanesKernel() for the refill logic.
+// Only the Mandelbrot formula is done in double-double, A tells which orbits are kept.
+template <class V, class A>
+inline void evaluateDeepLanesKernel ( const DeepView& v, const double* offre, const double* offim,
+				int n, LaneResult* out ) {
+	const DD<V> centerre = ddSet1<V>( v.cre, v.creLo ), centerim = ddSet1<V>( v.cim, v.cimLo );
+	const typename V::reg halfre = V::set1( v.halfre ), halfim = V::set1( v.halfim );
+	const typename V::reg four = V::set1( 4.0 ), zero = V::set1( 0.0 ), one = V::set1( 1.0 );
+	const typename V::reg tolerance = V::set1( v.tolerance );
+	const typename V::reg last = V::set1( v.high - 1.0 );
+
+	enum { RE, RELO, IM, IMLO, ZR, ZRLO, ZI, ZILO, CRITR, CRITRLO, CRITI, CRITILO,
+	       DISTANCE, CONTRIBUTE, ITERATION, CRITICALSTEP, STATES };
+	double state[STATES][V::width];
+	int slot[V::width];
+	unsigned int activeBits = 0;
+	int next = 0;
+
+	for ( int k = 0; k < V::width; ++k ) {
+		for ( int s = 0; s < STATES; ++s ) state[s][k] = 0.0;
+		slot[k] = -1;
+	}
+
+	DD<V> re, im, zr, zi, critr, criti;
+	typename V::reg distance, contribute, iteration, criticalStep;
+	do {
+		for ( int k = 0; k < V::width; ++k ) {
+			if ( activeBits & ( 1u << k ) ) continue;
+			slot[k] = -1;
+			while ( next < n && slot[k] == -1 ) {
+				LaneResult& r = out[next];
+				r.max = -1;
+				r.contribute = 0;
+				r.calculated = 0;
+				r.centerDistance = 64.0;
+
+				double cr, crLo, ci, ciLo;
+				addToDoubleDouble( v.cre, v.creLo, offre[next], cr, crLo );
+				addToDoubleDouble( v.cim, v.cimLo, offim[next], ci, ciLo );
+				if ( v.high > 0 && !( A::escaping && insideKnownInterior( v.interior, cr, ci ) ) ) {
+					slot[k] = next;
+					state[RE][k] = state[ZR][k] = state[CRITR][k] = cr;
+					state[RELO][k] = state[ZRLO][k] = state[CRITRLO][k] = crLo;
+					state[IM][k] = state[ZI][k] = state[CRITI][k] = ci;
+					state[IMLO][k] = state[ZILO][k] = state[CRITILO][k] = ciLo;
+					state[DISTANCE][k] = 64.0;
+					state[CONTRIBUTE][k] = state[ITERATION][k] = 0.0;
+					state[CRITICALSTEP][k] = v.periodicityStep;
+					activeBits |= 1u << k;
+				}
+				++next;
+			}
+		}
+
+		if ( activeBits == 0 ) break;
+
+		re.hi = V::load( state[RE] ); re.lo = V::load( state[RELO] );
+		im.hi = V::load( state[IM] ); im.lo = V::load( state[IMLO] );
+		zr.hi = V::load( state[ZR] ); zr.lo = V::load( state[ZRLO] );
+		zi.hi = V::load( state[ZI] ); zi.lo = V::load( state[ZILO] );
+		critr.hi = V::load( state[CRITR] ); critr.lo = V::load( state[CRITRLO] );
+		criti.hi = V::load( state[CRITI] ); criti.lo = V::load( state[CRITILO] );
+		distance = V::load( state[DISTANCE] ); contribute = V::load( state[CONTRIBUTE] );
+		iteration = V::load( state[ITERATION] ); criticalStep = V::load( state[CRITICALSTEP] );
+		const typename V::mask active = V::fromBits( activeBits );
+
+		unsigned int doneBits = 0, escapedBits = 0, periodicBits = 0;
+		while ( doneBits == 0 ) {
+			const DD<V> zr2 = ddSqr<V>( zr ), zi2 = ddSqr<V>( zi );
+			const typename V::reg norm = V::add( zr2.hi, zi2.hi );
+
+			// the point and its simmetric one relative to the center, here double is enough
+			const typename V::reg dr = ddSub<V>( zr, centerre ).hi;
+			const typename V::reg di = ddSub<V>( zi, centerim ).hi;
+			const typename V::reg dci = ddAdd<V>( zi, centerim ).hi;
+			const typename V::reg ndr = V::sub( zero, dr ), ndi = V::sub( zero, di ), ndci = V::sub( zero, dci );
+			typename V::mask isInside = V::andm( V::le( dr, halfre ), V::le( ndr, halfre ) );
+			isInside = V::andm( isInside, V::orm( V::andm( V::le( di, halfim ), V::le( ndi, halfim ) ),
+			                                      V::andm( V::le( dci, halfim ), V::le( ndci, halfim ) ) ) );
+			isInside = V::andm( isInside, active );
+			contribute = V::addIf( contribute, isInside, one );
+
+			const typename V::reg tmp = V::add( V::mul( dr, dr ), V::mul( di, di ) );
+			const typename V::mask closer = V::andm( V::lt( tmp, distance ), V::lt( norm, four ) );
+			distance = V::select( closer, tmp, distance );
+			distance = V::select( isInside, zero, distance );
+
+			const typename V::mask escaped = V::andnotm( isInside, V::andm( active, V::lt( four, norm ) ) );
+
+			const typename V::mask atStep = V::eq( iteration, criticalStep );
+			const typename V::mask afterStep = V::lt( criticalStep, iteration );
+			const typename V::reg pr = ddSub<V>( zr, critr ).hi, pi = ddSub<V>( zi, criti ).hi;
+			const typename V::mask periodic = V::andnotm( escaped, V::andm( V::andm( active, afterStep ),
+					V::lt( V::add( V::mul( pr, pr ), V::mul( pi, pi ) ), tolerance ) ) );
+			const typename V::reg doubleStep = V::add( criticalStep, criticalStep );
+			const typename V::mask doubling = V::andm( afterStep, V::eq( iteration, doubleStep ) );
+			const typename V::mask newCritical = V::orm( atStep, doubling );
+			critr.hi = V::select( newCritical, zr.hi, critr.hi );
+			critr.lo = V::select( newCritical, zr.lo, critr.lo );
+			criti.hi = V::select( newCritical, zi.hi, criti.hi );
+			criti.lo = V::select( newCritical, zi.lo, criti.lo );
+			criticalStep = V::select( doubling, doubleStep, criticalStep );
+
+			const typename V::mask limit = V::andm( active, V::eq( iteration, last ) );
+
+			doneBits = V::toBits( V::orm( V::orm( escaped, periodic ), limit ) );
+			if ( doneBits ) {
+				escapedBits = V::toBits( escaped );
+				periodicBits = V::toBits( periodic );
+			}
+
+			const DD<V> t = ddAdd<V>( ddSub<V>( zr2, zi2 ), re );
+			zi = ddAdd<V>( ddTwice<V>( ddMul<V>( zr, zi ) ), im );
+			zr = t;
+			iteration = V::add( iteration, one );
+		}
+
+		V::store( state[ZR], zr.hi ); V::store( state[ZRLO], zr.lo );
+		V::store( state[ZI], zi.hi ); V::store( state[ZILO], zi.lo );
+		V::store( state[CRITR], critr.hi ); V::store( state[CRITRLO], critr.lo );
+		V::store( state[CRITI], criti.hi ); V::store( state[CRITILO], criti.lo );
+		V::store( state[DISTANCE], distance ); V::store( state[CONTRIBUTE], contribute );
+		V::store( state[ITERATION], iteration ); V::store( state[CRITICALSTEP], criticalStep );
+
+		for ( int k = 0; k < V::width; ++k ) if ( doneBits & ( 1u << k ) ) {
+			LaneResult& r = out[slot[k]];
+			const unsigned int i = (unsigned int) state[ITERATION][k] - 1;
+			r.contribute = (unsigned int) state[CONTRIBUTE][k];
+			r.centerDistance = state[DISTANCE][k];
+			if ( escapedBits & ( 1u << k ) ) {
+				r.max = A::escaping ? i - 1 : -1;
+				r.calculated = i;
+			} else {
+				r.max = A::escaping ? -1 : (int) i;
+				r.calculated = ( periodicBits & ( 1u << k ) ) ? i : v.high;
+			}
+			activeBits &= ~( 1u << k );
+		}
+	} while ( activeBits != 0 || next < n );
+}
+
+template <class V, class A>
+void evaluateDeepLanesInstance ( const DeepView& v, const double* offre, const double* offim, int n, LaneResult* out ) {
+	evaluateDeepLanesKernel<V, A>( v, offre, offim, n, out );
+}
+
+template <class V>
+inline EvaluateDeepFunction deepLanesFor ( bool bounded ) {
+	return bounded ? &evaluateDeepLanesInstance<V, BoundedOrbits> : &evaluateDeepLanesInstance<V, EscapingOrbits>;
+}
+
+#endif
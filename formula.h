@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2010, Emilio Del Tessandoro
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY EMILIO DEL TESSANDORO o ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL EMILIO DEL TESSANDORO BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef FORMULA_H
+#define FORMULA_H
+
+// The fractals that can be rendered. Every formula is a policy class used as template parameter
+// of the kernels and of BuddhaGenerator::evaluate(), so every formula has its own fully
+// specialized code and the default one doesn't pay anything for the others.
+enum Formula { MANDELBROT_FORMULA, MULTIBROT3_FORMULA, BURNINGSHIP_FORMULA, FORMULAS };
+
+// A formula gives one step of the iteration for a vector type V (see evaluateLanesKernel(),
+// the scalar code uses ScalarLane). zr2 and zi2 are zr * zr and zi * zi, they are already
+// computed for the escape test.
+// symmetric is true when the orbit of the conjugate of c is the conjugate of the orbit of c,
+// so also the simmetric points can be drawn. knownInterior is true if the cardioid, the
+// bulbs and the InteriorMap can be used to skip the points. conformal is true when the formula
+// is holomorphic: then derivative() makes one step of dz / dc, that is f'( z ) * dz + 1, for
+// the distance estimate (see BuddhaGenerator::distanceEstimate()), that is not done for
+// the other formulas.
+
+// z^2 + c
+struct MandelbrotFormula {
+	enum { formula = MANDELBROT_FORMULA, symmetric = true, knownInterior = true, conformal = true };
+
+	static inline void derivative ( double zr, double zi, double& dr, double& di ) {
+		const double t = 2.0 * ( zr * dr - zi * di ) + 1.0;
+		di = 2.0 * ( zr * di + zi * dr );
+		dr = t;
+	}
+
+	template <class V>
+	static inline void step ( typename V::reg& zr, typename V::reg& zi, typename V::reg zr2, typename V::reg zi2,
+				  typename V::reg cr, typename V::reg ci ) {
+		const typename V::reg t = V::add( V::sub( zr2, zi2 ), cr );
+		zi = V::add( V::mul( V::add( zr, zr ), zi ), ci );
+		zr = t;
+	}
+};
+
+// z^d + c, with d > 2
+template <int d, Formula id>
+struct MultibrotFormula {
+	enum { formula = id, symmetric = true, knownInterior = false, conformal = true };
+
+	// d * z^(d - 1) * dz + 1
+	static inline void derivative ( double zr, double zi, double& dr, double& di ) {
+		double wr = d, wi = 0.0;
+		for ( int k = 1; k < d; ++k ) {
+			const double t = wr * zr - wi * zi;
+			wi = wr * zi + wi * zr;
+			wr = t;
+		}
+		const double t = wr * dr - wi * di + 1.0;
+		di = wr * di + wi * dr;
+		dr = t;
+	}
+
+	template <class V>
+	static inline void step ( typename V::reg& zr, typename V::reg& zi, typename V::reg, typename V::reg,
+				  typename V::reg cr, typename V::reg ci ) {
+		typename V::reg wr = zr, wi = zi;
+		for ( int k = 1; k < d; ++k ) {
+			const typename V::reg t = V::sub( V::mul( wr, zr ), V::mul( wi, zi ) );
+			wi = V::add( V::mul( wr, zi ), V::mul( wi, zr ) );
+			wr = t;
+		}
+		zr = V::add( wr, cr );
+		zi = V::add( wi, ci );
+	}
+};
+
+typedef MultibrotFormula<3, MULTIBROT3_FORMULA> Multibrot3Formula;
+
+// ( |re z| + i |im z| )^2 + c, it's not simmetric
+struct BurningShipFormula {
+	enum { formula = BURNINGSHIP_FORMULA, symmetric = false, knownInterior = false, conformal = false };
+
+	// the absolute values have no complex derivative
+	static inline void derivative ( double, double, double& dr, double& di ) {
+		dr = di = 0.0;
+	}
+
+	template <class V>
+	static inline void step ( typename V::reg& zr, typename V::reg& zi, typename V::reg zr2, typename V::reg zi2,
+				  typename V::reg cr, typename V::reg ci ) {
+		const typename V::reg zero = V::set1( 0 );
+		const typename V::reg ar = V::select( V::lt( zr, zero ), V::sub( zero, zr ), zr );
+		const typename V::reg ai = V::select( V::lt( zi, zero ), V::sub( zero, zi ), zi );
+		zr = V::add( V::sub( zr2, zi2 ), cr );
+		zi = V::add( V::mul( V::add( ar, ar ), ai ), ci );
+	}
+};
+
+
+// the same of F::symmetric when the formula is known only at run time
+inline bool symmetricFormula ( Formula formula ) {
+	switch ( formula ) {
+	case MULTIBROT3_FORMULA: return Multibrot3Formula::symmetric;
+	case BURNINGSHIP_FORMULA: return BurningShipFormula::symmetric;
+	default: return MandelbrotFormula::symmetric;
+	}
+}
+
+
+// Which orbits are drawn, also a template parameter. The Buddhabrot draws the orbits that
+// escape, the anti-Buddhabrot the ones that don't (found periodic or that reach the limit).
+struct EscapingOrbits {
+	enum { escaping = true };
+};
+
+struct BoundedOrbits {
+	enum { escaping = false };
+};
+
+#endif
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2010, Emilio Del Tessandoro
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY EMILIO DEL TESSANDORO o ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL EMILIO DEL TESSANDORO BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+
+
+#include "histogram.h"
+#include "simdKernel.h"
+
+
+// there is always a column and a row of tiles more than the image, so the points exactly on
+// the right or bottom side (x = w or y = h, the projection can give them) don't go outside
+void Histogram::resize ( unsigned int w, unsigned int h ) {
+	tiles = w / HISTOGRAM_SIDE + 1;
+	const unsigned int p = tiles * ( h / HISTOGRAM_SIDE + 1 ) * HISTOGRAM_TILE;
+	if ( p != pixels ) {
+		pixels = p;
+		for ( int c = 0; c < 3; ++c ) {
+			qFreeAligned( planes[c] );
+			planes[c] = (QAtomicInteger<quint16>*) qMallocAligned( pixels * sizeof( quint16 ), HISTOGRAM_ALIGNMENT );
+		}
+		spill.resize( 3 * pixels );
+	}
+	clear( );
+}
+
+// memset() is already vectorized
+void Histogram::clear ( ) {
+	for ( int c = 0; c < 3; ++c ) memset( (void*) planes[c], 0, pixels * sizeof( quint16 ) );
+	spill.clear( );
+}
+
+quint64 Histogram::maximum ( int channel ) const {
+	static const PlaneMaximumFunction planeMaximum = selectPlaneMaximum( );
+	const quint16 m = planeMaximum( (const unsigned short*) planes[channel], pixels );
+	return m < HISTOGRAM_SATURATED ? m : m + spill.maximum( channel * pixels, ( channel + 1 ) * pixels );
+}
+
+
+// the cells near the saturation, with compare and swap
+void Histogram::saturate ( int channel, unsigned int pixel, unsigned int count ) {
+	QAtomicInteger<quint16>& cell = planes[channel][pixel];
+	const unsigned int spilled = channel * pixels + pixel;
+	quint16 old = cell.load( );
+	for ( ;; ) {
+		if ( old == HISTOGRAM_SATURATED ) {
+			spill.add( spilled, count );
+			return;
+		}
+		const unsigned int sum = old + count;
+		if ( cell.testAndSetRelaxed( old, std::min( sum, (unsigned int) HISTOGRAM_SATURATED ), old ) ) {
+			if ( sum > HISTOGRAM_SATURATED ) spill.add( spilled, sum - HISTOGRAM_SATURATED );
+			return;
+		}
+	}
+}
+
+
+void SpillTable::resize ( unsigned int cells ) {
+	unsigned int s = SPILLTABLE_MIN;
+	while ( s < cells / SPILLTABLE_RATIO ) s *= 2;
+	if ( s != capacity ) {
+		delete[] keys;
+		delete[] counts;
+		capacity = s;
+		keys = new QAtomicInteger<quint32>[capacity];
+		counts = new QAtomicInteger<quint64>[capacity];
+	}
+	clear( );
+}
+
+quint64 SpillTable::maximum ( unsigned int first, unsigned int last ) const {
+	quint64 m = 0;
+	for ( unsigned int i = 0; i < capacity; ++i ) {
+		const quint32 k = keys[i].load( );
+		if ( k > first && k <= last ) m = std::max( m, (quint64) counts[i].load( ) );
+	}
+	return m;
+}
+
+void SpillTable::clear ( ) {
+	for ( unsigned int i = 0; i < capacity; ++i ) {
+		keys[i].store( 0 );
+		counts[i].store( 0 );
+	}
+	lost.store( 0 );
+}
@@ -0,0 +1,314 @@
+/*
+ * Copyright (c) 2010, Emilio Del Tessandoro
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY EMILIO DEL TESSANDORO o ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL EMILIO DEL TESSANDORO BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <cstring>
+#include <algorithm>
+#include <QAtomicInteger>
+#include <QtGlobal>
+
+// the channels of a splat, the bits of its mask
+#define RED_CHANNEL		1
+#define GREEN_CHANNEL		2
+#define BLUE_CHANNEL		4
+
+// a tile is a square of HISTOGRAM_SIDE pixels, consecutive in the histogram. The unit of the
+// TileCache. The side is 16 for the table of tiledPixel().
+#define HISTOGRAM_SIDE		16
+#define HISTOGRAM_TILE		( HISTOGRAM_SIDE * HISTOGRAM_SIDE )
+// tiles kept by the cache of a generator, and the splats after which it's all written
+#define TILECACHE_TILES		32
+#define TILECACHE_FLUSH		( 1 << 20 )
+// splats kept by a generator before they are sorted and written, and the regions of the
+// image where they are sorted. The pixels of an image must be less than 2^29.
+#define SPLATBUFFER_SIZE	16384
+#define SPLATBUFFER_BUCKETS	1024
+// the biggest count of a cell of the histogram, the rest goes in the SpillTable. The table
+// has a slot every SPILLTABLE_RATIO cells, and at least SPILLTABLE_MIN.
+#define HISTOGRAM_SATURATED	0xFFFF
+// the cells and the counts that are incremented without compare and swap, see Histogram
+#define HISTOGRAM_FASTLIMIT	0x8000
+#define HISTOGRAM_FASTCOUNT	64
+// of the planes, for the vectorized kernels
+#define HISTOGRAM_ALIGNMENT	64
+#define SPILLTABLE_RATIO	64
+#define SPILLTABLE_MIN		4096
+
+// how the generators write in the histogram, see Buddha::setHistogramStrategy()
+enum HistogramStrategy { ATOMIC_HISTOGRAM, TILECACHE_HISTOGRAM };
+
+
+// The offset of the pixel (x, y) in the histogram, with tiles tiles in a row: the tiles are
+// row after row and the pixels of a tile in Z-order, so the points near on the screen, like
+// the ones of an orbit, are near also in memory. Static like insideInterior().
+static inline unsigned int tiledPixel ( unsigned int x, unsigned int y, unsigned int tiles ) {
+	static const unsigned char spread[16] = { 0x00, 0x01, 0x04, 0x05, 0x10, 0x11, 0x14, 0x15,
+						  0x40, 0x41, 0x44, 0x45, 0x50, 0x51, 0x54, 0x55 };
+	return ( ( y / HISTOGRAM_SIDE ) * tiles + x / HISTOGRAM_SIDE ) * HISTOGRAM_TILE |
+	       spread[x % HISTOGRAM_SIDE] | spread[y % HISTOGRAM_SIDE] << 1;
+}
+
+
+// The counts over HISTOGRAM_SATURATED of the cells of the Histogram, only the bright pixels
+// have them. An open addressing table with linear probing, filled with compare and swap
+// like the PeriodicCache: the key of a cell is its index + 1, 0 is empty. The slots are
+// never freed, if the table is full the counts are lost (and counted in lost).
+class SpillTable {
+public:
+	SpillTable ( ) : capacity( 0 ), keys( NULL ), counts( NULL ) { }
+	~SpillTable ( ) { delete[] keys; delete[] counts; }
+
+	// with the generators paused, the counts are lost
+	void resize ( unsigned int cells );
+	void clear ( );
+
+	void add ( unsigned int cell, quint64 count ) {
+		const quint32 key = cell + 1;
+		for ( unsigned int i = 0, s = hash( key ); i < capacity; ++i, s = ( s + 1 ) & ( capacity - 1 ) ) {
+			const quint32 k = keys[s].load( );
+			if ( k == key || ( k == 0 && ( keys[s].testAndSetRelaxed( 0, key ) || keys[s].load( ) == key ) ) ) {
+				counts[s].fetchAndAddRelaxed( count );
+				return;
+			}
+		}
+		lost.fetchAndAddRelaxed( count );
+	}
+
+	// the biggest count of the cells in [first, last)
+	quint64 maximum ( unsigned int first, unsigned int last ) const;
+
+	quint64 value ( unsigned int cell ) const {
+		const quint32 key = cell + 1;
+		for ( unsigned int i = 0, s = hash( key ); i < capacity; ++i, s = ( s + 1 ) & ( capacity - 1 ) ) {
+			const quint32 k = keys[s].load( );
+			if ( k == key ) return counts[s].load( );
+			if ( k == 0 ) return 0;
+		}
+		return 0;
+	}
+
+	QAtomicInteger<quint64> lost;
+
+private:
+	unsigned int hash ( quint32 key ) const { return ( key * 2654435761u ) & ( capacity - 1 ); }
+
+	unsigned int capacity;
+	QAtomicInteger<quint32>* keys;
+	QAtomicInteger<quint64>* counts;
+};
+
+
+// The counts of the three channels of every pixel, one for all the generators, so the memory
+// doesn't grow with the threads and the image is made reading it directly, there is nothing
+// to reduce. The generators increment it with atomic increments (relaxed: only the sum
+// matters), directly or from a TileCache. The pixels are in tiles, see tiledPixel(), only
+// the image is in rows.
+// The cells have 16 bits and stop at HISTOGRAM_SATURATED, what's more goes in the spill
+// table: most of the pixels never arrive there, and the long renders don't wrap around.
+// Near the saturation an increment is a compare and swap, see saturate().
+// Every channel is a plane, aligned for the vectorized kernels that read it (a QAtomicInteger
+// is only its value in memory), and the cell c * size() + pixel of the spill table is the
+// one of the pixel in the channel c.
+class Histogram {
+public:
+	Histogram ( ) : pixels( 0 ), tiles( 0 ) { planes[0] = planes[1] = planes[2] = NULL; }
+	~Histogram ( ) { for ( int c = 0; c < 3; ++c ) qFreeAligned( planes[c] ); }
+
+	// the counts are lost. Both with the generators paused.
+	void resize ( unsigned int w, unsigned int h );
+	void clear ( );
+
+	// the pixels with the ones of the tiles on the borders, that are outside of the image
+	unsigned int size ( ) const { return pixels; }
+	unsigned int tilesInRow ( ) const { return tiles; }
+	unsigned int index ( unsigned int x, unsigned int y ) const { return tiledPixel( x, y, tiles ); }
+
+	inline void add ( unsigned int pixel, unsigned int mask ) {
+		if ( mask & RED_CHANNEL ) increment( 0, pixel, 1 );
+		if ( mask & GREEN_CHANNEL ) increment( 1, pixel, 1 );
+		if ( mask & BLUE_CHANNEL ) increment( 2, pixel, 1 );
+	}
+
+	inline void add ( unsigned int pixel, int channel, unsigned int count ) {
+		increment( channel, pixel, count );
+	}
+
+	// only the saturated cells look in the spill table
+	inline quint64 value ( unsigned int pixel, int channel ) const {
+		const quint16 v = planes[channel][pixel].load( );
+		return v < HISTOGRAM_SATURATED ? v : v + spill.value( channel * pixels + pixel );
+	}
+
+	// the biggest value of a channel, with the vectorized kernels
+	quint64 maximum ( int channel ) const;
+
+	SpillTable spill;
+
+private:
+	// under half of the range an atomic add is enough: to pass the saturation more than
+	// HISTOGRAM_FASTLIMIT / HISTOGRAM_FASTCOUNT generators should add together
+	inline void increment ( int channel, unsigned int pixel, unsigned int count ) {
+		QAtomicInteger<quint16>& cell = planes[channel][pixel];
+		if ( cell.load( ) < HISTOGRAM_FASTLIMIT && count <= HISTOGRAM_FASTCOUNT ) cell.fetchAndAddRelaxed( count );
+		else saturate( channel, pixel, count );
+	}
+
+	void saturate ( int channel, unsigned int pixel, unsigned int count );
+
+	unsigned int pixels, tiles;
+	QAtomicInteger<quint16>* planes[3];
+};
+
+
+// The increments of a generator for the tiles it used last, so most of the splats of an
+// orbit go in a small memory of the thread instead of in the shared histogram. It's direct
+// mapped: the tile t goes in the line t % TILECACHE_TILES and the tile that was there is
+// added to the Histogram before. Everything is added after TILECACHE_FLUSH splats, and
+// when the generator is paused or stopped, see flush().
+class TileCache {
+public:
+	TileCache ( ) : histogram( NULL ) { discard( ); }
+
+	// the increments not flushed are lost
+	void attach ( Histogram* h ) {
+		histogram = h;
+		discard( );
+	}
+
+	void discard ( ) {
+		splats = 0;
+		for ( int i = 0; i < TILECACHE_TILES; ++i ) {
+			lines[i].tile = EMPTY;
+			lines[i].used = 0;
+			memset( lines[i].counts, 0, sizeof( lines[i].counts ) );
+		}
+	}
+
+	// the mask is never 0
+	inline void add ( unsigned int pixel, unsigned int mask ) {
+		const unsigned int tile = pixel / HISTOGRAM_TILE;
+		Line& s = lines[tile % TILECACHE_TILES];
+		if ( s.tile != tile ) {
+			flush( s );
+			s.tile = tile;
+		}
+		const unsigned int p = pixel % HISTOGRAM_TILE;
+		unsigned int* cell = s.counts[p];
+		if ( ( cell[0] | cell[1] | cell[2] ) == 0 ) s.touched[s.used++] = p;
+		cell[0] += mask & RED_CHANNEL;
+		cell[1] += ( mask & GREEN_CHANNEL ) >> 1;
+		cell[2] += ( mask & BLUE_CHANNEL ) >> 2;
+		if ( ++splats >= TILECACHE_FLUSH ) flush( );
+	}
+
+	// adds everything to the histogram
+	void flush ( ) {
+		for ( int i = 0; i < TILECACHE_TILES; ++i ) flush( lines[i] );
+		splats = 0;
+	}
+
+private:
+	static const unsigned int EMPTY = 0xFFFFFFFFu;
+
+	// used is the number of the pixels in touched, the ones with some count
+	struct Line {
+		unsigned int tile, used;
+		unsigned int counts[HISTOGRAM_TILE][3];
+		unsigned short touched[HISTOGRAM_TILE];
+	};
+
+	// only the touched pixels, an orbit often passes in a tile for a few points
+	void flush ( Line& s ) {
+		for ( unsigned int i = 0; i < s.used; ++i ) {
+			unsigned int* cell = s.counts[s.touched[i]];
+			const unsigned int pixel = s.tile * HISTOGRAM_TILE + s.touched[i];
+			for ( int c = 0; c < 3; ++c ) {
+				if ( cell[c] == 0 ) continue;
+				histogram->add( pixel, c, cell[c] );
+				cell[c] = 0;
+			}
+		}
+		s.used = 0;
+	}
+
+	Histogram* histogram;
+	unsigned int splats;
+	Line lines[TILECACHE_TILES];
+};
+
+
+
+// The splats of a generator in the order they are made, the pixel and the mask packed in an
+// int. An orbit jumps all over the image, so writing them as they come is a cache miss for
+// every point: when the buffer is full it's sorted by regions of the image (a counting sort,
+// contiguous tiles in the same bucket) and written a region after the other, so the counters
+// of a region are read from memory once.
+class SplatBuffer {
+public:
+	SplatBuffer ( ) : used( 0 ), shift( 0 ) { }
+
+	// for an image of pixels pixels, the splats are lost
+	void attach ( unsigned int pixels ) {
+		used = 0;
+		shift = 0;
+		while ( pixels > 0 && ( pixels - 1 ) >> shift >= SPLATBUFFER_BUCKETS ) ++shift;
+	}
+
+	void discard ( ) { used = 0; }
+
+	// true when the buffer is full and must be flushed
+	inline bool add ( unsigned int pixel, unsigned int mask ) {
+		entries[used++] = pixel << 3 | mask;
+		return used == SPLATBUFFER_SIZE;
+	}
+
+	// writes the splats in the cache or, if it's NULL, directly in the histogram
+	void flush ( TileCache* cache, Histogram* histogram ) {
+		if ( used == 0 ) return;
+		unsigned int starts[SPLATBUFFER_BUCKETS + 1] = { 0 };
+		for ( unsigned int i = 0; i < used; ++i ) ++starts[( entries[i] >> 3 >> shift ) + 1];
+		for ( int k = 0; k < SPLATBUFFER_BUCKETS; ++k ) starts[k + 1] += starts[k];
+		for ( unsigned int i = 0; i < used; ++i ) sorted[starts[entries[i] >> 3 >> shift]++] = entries[i];
+
+		if ( cache ) for ( unsigned int i = 0; i < used; ++i ) cache->add( sorted[i] >> 3, sorted[i] & 7 );
+		else for ( unsigned int i = 0; i < used; ++i ) histogram->add( sorted[i] >> 3, sorted[i] & 7 );
+		used = 0;
+	}
+
+private:
+	unsigned int used, shift;
+	unsigned int entries[SPLATBUFFER_SIZE];
+	unsigned int sorted[SPLATBUFFER_SIZE];
+};
+
+
+#endif // HISTOGRAM_H
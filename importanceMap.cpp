@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2010, Emilio Del Tessandoro
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY EMILIO DEL TESSANDORO o ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL EMILIO DEL TESSANDORO BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+
+#include "importanceMap.h"
+#include <algorithm>
+#include <cmath>
+
+
+ImportanceMap::ImportanceMap ( ) : cumulative( IMPORTANCE_SIZE * IMPORTANCE_SIZE, 0.0 ) {
+	reset( );
+}
+
+
+void ImportanceMap::reset ( ) {
+	taken.store( 0 );
+	done.store( 0 );
+	readyFlag.store( 0 );
+}
+
+
+void ImportanceMap::setRow ( int row, const double* weights ) {
+	std::copy( weights, weights + IMPORTANCE_SIZE, cumulative.begin() + row * IMPORTANCE_SIZE );
+	if ( done.fetchAndAddOrdered( 1 ) + 1 < IMPORTANCE_SIZE ) return;
+
+	// the last row, all the others are already here
+	double sum = 0.0;
+	for ( unsigned int i = 0; i < cumulative.size(); ++i ) {
+		sum += cumulative[i];
+		cumulative[i] = sum;
+	}
+	// no orbit of the cells is useful, the map stays not ready
+	if ( sum > 0.0 ) readyFlag.storeRelease( 1 );
+}
+
+
+double ImportanceMap::density ( double re, double im ) const {
+	const int x = (int) floor( ( re - IMPORTANCE_MIN ) / cellSize( ) );
+	const int y = (int) floor( ( IMPORTANCE_MAX - im ) / cellSize( ) );
+	if ( x < 0 || y < 0 || x >= IMPORTANCE_SIZE || y >= IMPORTANCE_SIZE ) return 0.0;
+
+	const int i = y * IMPORTANCE_SIZE + x;
+	const double weight = cumulative[i] - ( i > 0 ? cumulative[i - 1] : 0.0 );
+	return weight / ( cumulative.back() * cellSize( ) * cellSize( ) );
+}
+
+
+void ImportanceMap::sample ( Random& generator, double& re, double& im ) const {
+	// the first partial sum bigger than u, it's never a cell with no weight. real() can
+	// give 1, then it's the first cell where the sum is complete
+	const double u = generator.real() * cumulative.back();
+	std::vector<double>::const_iterator cell = std::upper_bound( cumulative.begin(), cumulative.end(), u );
+	if ( cell == cumulative.end() ) cell = std::lower_bound( cumulative.begin(), cumulative.end(), cumulative.back() );
+	const int i = cell - cumulative.begin();
+	re = IMPORTANCE_MIN + ( i % IMPORTANCE_SIZE + generator.real() ) * cellSize( );
+	im = IMPORTANCE_MAX - ( i / IMPORTANCE_SIZE + generator.real() ) * cellSize( );
+}
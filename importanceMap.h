@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2010, Emilio Del Tessandoro
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY EMILIO DEL TESSANDORO o ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL EMILIO DEL TESSANDORO BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+
+#ifndef IMPORTANCEMAP_H
+#define IMPORTANCEMAP_H
+
+#include <vector>
+#include <QAtomicInt>
+#include "random.h"
+
+// cells per side of the map, that covers the square where all the formulas live
+#define IMPORTANCE_SIZE		256
+#define IMPORTANCE_MIN		-2.0
+#define IMPORTANCE_MAX		2.0
+
+
+// A coarse map of the plane of c that says where to start the search of findPoint(). Every
+// cell has a weight, bigger if the orbit of its center falls in the window or passes near it,
+// and the starting points are chosen in proportion to it.
+// The map is computed again for every view. The rows are taken by the generators with
+// nextRow() and given back with setRow(), so they compute it in parallel when they have
+// nothing better to do. When the last row arrives the map is ready, until then findPoint()
+// starts from the origin as before.
+class ImportanceMap {
+public:
+	ImportanceMap ( );
+
+	// forgets the map, the generators must be paused or stopped
+	void reset ( );
+
+	// a row not taken yet, false if all the rows are taken
+	bool nextRow ( int& row ) {
+		row = taken.fetchAndAddOrdered( 1 );
+		return row < IMPORTANCE_SIZE;
+	}
+	// the weights of the IMPORTANCE_SIZE cells of a row
+	void setRow ( int row, const double* weights );
+
+	bool ready ( ) const { return readyFlag.loadAcquire( ) != 0; }
+
+	// the center of a cell
+	static double cellRe ( int x ) { return IMPORTANCE_MIN + ( x + 0.5 ) * cellSize( ); }
+	static double cellIm ( int y ) { return IMPORTANCE_MAX - ( y + 0.5 ) * cellSize( ); }
+	static double cellSize ( ) { return ( IMPORTANCE_MAX - IMPORTANCE_MIN ) / IMPORTANCE_SIZE; }
+
+	// a random point in a cell chosen in proportion to the weights, the map must be ready
+	void sample ( Random& generator, double& re, double& im ) const;
+	// the probability density of the points given by sample()
+	double density ( double re, double im ) const;
+
+private:
+	// the weights, and when the map is ready their partial sums
+	std::vector<double> cumulative;
+	QAtomicInt taken, done, readyFlag;
+};
+
+#endif
@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2010, Emilio Del Tessandoro
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY EMILIO DEL TESSANDORO o ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL EMILIO DEL TESSANDORO BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "interiorMap.h"
+#include "simdKernel.h"
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <complex>
+
+using std::complex;
+
+
+InteriorMap::InteriorMap ( ) {
+	invCell = INTERIOR_WIDTH / ( INTERIOR_MAXRE - INTERIOR_MINRE );
+}
+
+
+// Estimate of the distance of c from the border of the Mandelbrot set, if c is in an
+// interior component, otherwise 0. outside is set to the estimate of the distance for the
+// points that escape. The periodicity is found like in evaluate(), then the periodic
+// point is refined with Newton and the interior distance estimate is
+//	b = ( 1 - |dz|^2 ) / | dcdz + dzdz * dc / ( 1 - dz ) |
+// where the derivatives are of the iterated function along the cycle. The disk of radius
+// b / 4 around c is inside the set (Koebe 1/4 theorem), and the same for the exterior
+// estimate 2 |z| log|z| / |dc| with the points outside.
+static double interiorDistance ( double cr, double ci, double& outside ) {
+	typedef complex<double> C;
+	const C c( cr, ci );
+	C z = c, critical = c, dc( 1.0, 0.0 );
+	unsigned int criticalStep = STEP, period = 0;
+	outside = 0.0;
+
+	for ( unsigned int i = 0; i < INTERIOR_ITERATIONS && period == 0; ++i ) {
+		if ( norm( z ) > INTERIOR_ESCAPE ) {
+			outside = 2.0 * abs( z ) * log( abs( z ) ) / abs( dc );
+			return 0.0;
+		}
+
+		if ( i == criticalStep ) {
+			critical = z;
+		} else if ( i > criticalStep ) {
+			if ( norm( z - critical ) < INTERIOR_TOLERANCE ) {
+				period = i - criticalStep;
+				break;
+			}
+			if ( i == criticalStep * 2 ) {
+				criticalStep *= 2;
+				critical = z;
+			}
+		}
+
+		dc = 2.0 * z * dc + 1.0;
+		z = z * z + c;
+	}
+	if ( period == 0 ) return 0.0;
+
+	// Newton on f^period(z) - z = 0, z is already near the solution
+	C dz;
+	for ( int n = 0; n < 8; ++n ) {
+		C w = z;
+		dz = 1.0;
+		for ( unsigned int k = 0; k < period; ++k ) {
+			dz = 2.0 * w * dz;
+			w = w * w + c;
+		}
+		if ( dz == 1.0 ) return 0.0;
+		z -= ( w - z ) / ( dz - 1.0 );
+	}
+
+	C w = z, dcdz = 0.0, dzdz = 0.0;
+	dz = 1.0;
+	dc = 0.0;
+	for ( unsigned int k = 0; k < period; ++k ) {
+		dcdz = 2.0 * ( w * dcdz + dc * dz );
+		dc = 2.0 * w * dc + 1.0;
+		dzdz = 2.0 * ( dz * dz + w * dzdz );
+		dz = 2.0 * w * dz;
+		w = w * w + c;
+	}
+
+	// not attracting, or Newton went somewhere else
+	if ( norm( dz ) >= 1.0 || norm( w - z ) > INTERIOR_TOLERANCE ) return 0.0;
+	return ( 1.0 - norm( dz ) ) / abs( dcdz + dzdz * dc / ( 1.0 - dz ) );
+}
+
+
+// Builds the finest level as a quadtree: if the disk given by the distance estimate at the
+// center of a square contains the square, the square is all inside (or all outside) and
+// it's not split further. This way the big areas are done with a few points.
+void InteriorMap::subdivide ( int x, int y, int size ) {
+	const double cell = 1.0 / invCell;
+	const double cr = INTERIOR_MINRE + ( x + 0.5 * size ) * cell;
+	const double ci = ( y + 0.5 * size ) * cell;
+	const double radius = sqrt( 0.5 ) * size * cell;
+	double outside;
+	const double inside = interiorDistance( cr, ci, outside );
+
+	if ( INTERIOR_SAFETY * 0.25 * inside >= radius ) {
+		for ( int j = y; j < y + size; ++j )
+			for ( int i = x; i < x + size; ++i )
+				setCell( i, j );
+		return;
+	}
+
+	if ( INTERIOR_SAFETY * 0.25 * outside >= radius || size == 1 ) return;
+	size /= 2;
+	subdivide( x, y, size );
+	subdivide( x + size, y, size );
+	subdivide( x, y + size, size );
+	subdivide( x + size, y + size, size );
+}
+
+
+void InteriorMap::summarize ( ) {
+	const int blocksPerRow = INTERIOR_WIDTH / INTERIOR_BLOCK;
+	blocks.assign( blocksPerRow * ( INTERIOR_HEIGHT / INTERIOR_BLOCK ), EMPTY );
+
+	for ( int by = 0; by < INTERIOR_HEIGHT / INTERIOR_BLOCK; ++by ) {
+		for ( int bx = 0; bx < blocksPerRow; ++bx ) {
+			bool empty = true, full = true;
+			for ( int y = by * INTERIOR_BLOCK; y < ( by + 1 ) * INTERIOR_BLOCK; ++y ) {
+				const unsigned int word = cells[y * ( INTERIOR_WIDTH / 32 ) + bx];
+				empty = empty && word == 0;
+				full = full && word == 0xFFFFFFFFu;
+			}
+			blocks[by * blocksPerRow + bx] = empty ? EMPTY : full ? FULL : PARTIAL;
+		}
+	}
+}
+
+
+void InteriorMap::build ( ) {
+	blocks.clear( );
+	cells.assign( INTERIOR_HEIGHT * INTERIOR_WIDTH / 32, 0 );
+
+	for ( int x = 0; x < INTERIOR_WIDTH; x += INTERIOR_HEIGHT )
+		subdivide( x, 0, INTERIOR_HEIGHT );
+
+	summarize( );
+}
+
+
+
+// the cache file is a small header with the parameters of the map, and the bitmap
+struct InteriorMapHeader {
+	char magic[4];
+	int width, height, iterations;
+	double tolerance;
+};
+
+static void fillHeader ( InteriorMapHeader& h ) {
+	memcpy( h.magic, "WBIM", 4 );
+	h.width = INTERIOR_WIDTH;
+	h.height = INTERIOR_HEIGHT;
+	h.iterations = INTERIOR_ITERATIONS;
+	h.tolerance = INTERIOR_TOLERANCE;
+}
+
+bool InteriorMap::load ( const char* fileName ) {
+	FILE* file = fopen( fileName, "rb" );
+	if ( !file ) return false;
+
+	InteriorMapHeader expected, header;
+	fillHeader( expected );
+	std::vector<unsigned int> data( INTERIOR_HEIGHT * INTERIOR_WIDTH / 32 );
+	bool ok = fread( &header, sizeof( header ), 1, file ) == 1 &&
+		  memcmp( header.magic, expected.magic, 4 ) == 0 &&
+		  header.width == expected.width && header.height == expected.height &&
+		  header.iterations == expected.iterations && header.tolerance == expected.tolerance &&
+		  fread( &data[0], sizeof( unsigned int ), data.size(), file ) == data.size();
+	fclose( file );
+
+	if ( !ok ) return false;
+	cells.swap( data );
+	summarize( );
+	return true;
+}
+
+bool InteriorMap::save ( const char* fileName ) const {
+	if ( !ready( ) ) return false;
+	FILE* file = fopen( fileName, "wb" );
+	if ( !file ) return false;
+
+	InteriorMapHeader header;
+	memset( &header, 0, sizeof( header ) );
+	fillHeader( header );
+	bool ok = fwrite( &header, sizeof( header ), 1, file ) == 1 &&
+		  fwrite( &cells[0], sizeof( unsigned int ), cells.size(), file ) == cells.size();
+	return fclose( file ) == 0 && ok;
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2010, Emilio Del Tessandoro
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY EMILIO DEL TESSANDORO o ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL EMILIO DEL TESSANDORO BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef INTERIORMAP_H
+#define INTERIORMAP_H
+
+#include <vector>
+#include <cstddef>
+
+// The map covers the upper half of the region where the Mandelbrot set is (the set is
+// simmetric, for the negative imaginary parts I use the absolute value).
+#define INTERIOR_MINRE		-2.0
+#define INTERIOR_MAXRE		0.5
+#define INTERIOR_MAXIM		1.25
+// cells in the finest level, and cells per side of a block of the coarse level.
+// A row of a block is exactly one word of the bitmap.
+#define INTERIOR_WIDTH		4096
+#define INTERIOR_HEIGHT		2048
+#define INTERIOR_BLOCK		32
+// iterations and periodicity tolerance (squared) used to find the period of the points,
+// the escape radius (squared, big for a good exterior estimate) and a margin on the disks
+// given by the distance estimates, for the rounding errors
+#define INTERIOR_ITERATIONS	( 1 << 12 )
+#define INTERIOR_TOLERANCE	1.0e-24
+#define INTERIOR_ESCAPE		1.0e20
+#define INTERIOR_SAFETY		0.5
+#define INTERIOR_CACHE		"interior.map"
+
+
+// The data of the map that a lookup needs, without the vectors: the vectorized kernels take
+// this instead of the InteriorMap, see insideInterior(). cells is NULL if the map is not ready.
+struct InteriorView {
+	double invCell;
+	const unsigned int* cells;
+	const unsigned char* blocks;
+};
+
+// the states of the blocks of the coarse level
+enum { INTERIOR_EMPTY, INTERIOR_PARTIAL, INTERIOR_FULL };
+
+// static, so every translation unit has its copy: the ones compiled for AVX2 or AVX-512
+// must not give their version to the rest of the program, see simdKernelAVX2.cpp
+static inline bool insideInterior ( const InteriorView& v, double re, double im ) {
+	if ( im < 0.0 ) im = -im;
+	if ( !( re >= INTERIOR_MINRE && im < INTERIOR_MAXIM ) || !v.cells ) return false;
+
+	const unsigned int x = ( re - INTERIOR_MINRE ) * v.invCell;
+	const unsigned int y = im * v.invCell;
+	if ( x >= INTERIOR_WIDTH || y >= INTERIOR_HEIGHT ) return false;
+	const unsigned char block = v.blocks[( y / INTERIOR_BLOCK ) * ( INTERIOR_WIDTH / INTERIOR_BLOCK ) + x / INTERIOR_BLOCK];
+	if ( block != INTERIOR_PARTIAL ) return block == INTERIOR_FULL;
+	return ( v.cells[y * ( INTERIOR_WIDTH / 32 ) + x / 32] >> ( x % 32 ) ) & 1;
+}
+
+
+// A precomputed map of cells that are completely inside the Mandelbrot set, to reject
+// the points there in O(1) before iterating, like the test of the cardioid and the bulbs
+// but for all the interior components big enough to contain a cell.
+// There are two levels: a coarse one with the state of blocks of INTERIOR_BLOCK^2 cells,
+// that is small and stays in the cache, and a bitmap of the cells that is read only
+// for the blocks that are partially inside.
+class InteriorMap {
+public:
+	InteriorMap ( );
+
+	// computes the map, it takes some seconds
+	void build ( );
+	// loads and saves the map from/to a cache file, false if something went wrong
+	bool load ( const char* fileName );
+	bool save ( const char* fileName ) const;
+
+	bool ready ( ) const { return !blocks.empty(); }
+
+	// valid until the map is built or loaded again
+	inline InteriorView view ( ) const {
+		InteriorView v = { invCell, blocks.empty() ? NULL : &cells[0], blocks.empty() ? NULL : &blocks[0] };
+		return v;
+	}
+
+	inline bool inside ( double re, double im ) const {
+		return insideInterior( view( ), re, im );
+	}
+
+private:
+	enum { EMPTY = INTERIOR_EMPTY, PARTIAL = INTERIOR_PARTIAL, FULL = INTERIOR_FULL };
+
+	void subdivide ( int x, int y, int size );
+	void summarize ( );
+
+	void setCell ( int x, int y ) { cells[y * ( INTERIOR_WIDTH / 32 ) + x / 32] |= 1u << ( x % 32 ); }
+	bool cell ( int x, int y ) const { return ( cells[y * ( INTERIOR_WIDTH / 32 ) + x / 32] >> ( x % 32 ) ) & 1; }
+
+	double invCell;
+	std::vector<unsigned int> cells;
+	std::vector<unsigned char> blocks;
+};
+
+#endif
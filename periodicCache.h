@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2010, Emilio Del Tessandoro
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY EMILIO DEL TESSANDORO o ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL EMILIO DEL TESSANDORO BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+
+
+#ifndef PERIODICCACHE_H
+#define PERIODICCACHE_H
+
+#include <cmath>
+#include <algorithm>
+#include <QAtomicInt>
+#include <QAtomicInteger>
+
+// entries of the table (a power of two) and places looked for a key after its own
+#define PERIODICCACHE_BITS		16
+#define PERIODICCACHE_PROBES		8
+// the side of the cells in pixels of the window, but never more than PERIODICCACHE_MAX_CELL in
+// the complex plane, and the periodic points needed in a cell (with no point escaping) before
+// the proposals there are rejected. At low magnification two pixels are big enough to cross
+// the border of the set, where the good orbits are, so the cells are kept well under the ones
+// of the InteriorMap (about 6e-4).
+#define PERIODICCACHE_PIXELS		2.0
+#define PERIODICCACHE_MAX_CELL		1.0e-4
+#define PERIODICCACHE_CONFIDENCE	4
+// one time in this number a point in an interior cell is iterated anyway, so the cells
+// wrong because they are on the border can still see an escaping point
+#define PERIODICCACHE_RECHECK		16
+
+
+// The cells of c where the generators found periodic points during the rendering, shared by
+// all of them. It completes the known bulbs and the InteriorMap: the small interior components
+// around the window, that the map is too coarse for, are learned while the chains pass there.
+// The table is hashed with linear probing and has no locks: the keys are taken with a
+// compare and swap, and a lost update of a counter only delays the confidence. A cell where
+// a point escaped is mixed forever and it's never rejected, also when the escape came before
+// any periodic point. When it's full the new cells are simply not recorded.
+class PeriodicCache {
+public:
+	PeriodicCache ( ) : invCell( 0.0 ) { }
+
+	// forgets all the cells, the new ones are for a window of this scale (pixels for a unit
+	// of the complex plane). The generators must not be running.
+	void clear ( double scale ) {
+		invCell = std::max( scale / PERIODICCACHE_PIXELS, 1.0 / PERIODICCACHE_MAX_CELL );
+		for ( int i = 0; i < ( 1 << PERIODICCACHE_BITS ); ++i ) {
+			keys[i].store( 0 );
+			counts[i].store( 0 );
+		}
+	}
+
+	// true if enough periodic points and no escaping one were found in the cell of c
+	bool interior ( double re, double im ) {
+		const int i = find( key( re, im ), false );
+		return i >= 0 && counts[i].load( ) >= PERIODICCACHE_CONFIDENCE;
+	}
+
+	void periodic ( double re, double im ) {
+		const int i = find( key( re, im ), true );
+		if ( i < 0 ) return;
+		const int count = counts[i].load( );
+		if ( count >= 0 && count < PERIODICCACHE_CONFIDENCE ) counts[i].testAndSetRelaxed( count, count + 1 );
+	}
+
+	// the cell is taken even if no periodic point was seen yet, or an escape before the first
+	// one would be forgotten and the cell could become interior later
+	void escaping ( double re, double im ) {
+		const int i = find( key( re, im ), true );
+		if ( i >= 0 ) counts[i].store( MIXED );
+	}
+
+private:
+	enum { MIXED = -1 };
+
+	// a mix of the coordinates of the cell, never 0 (the empty entries)
+	quint64 key ( double re, double im ) const {
+		quint64 h = (quint64) (qint64) floor( re * invCell ) * 0x9E3779B97F4A7C15ULL;
+		h ^= (quint64) (qint64) floor( im * invCell ) + 0xBF58476D1CE4E5B9ULL + ( h << 6 ) + ( h >> 2 );
+		h = ( h ^ ( h >> 31 ) ) * 0x94D049BB133111EBULL;
+		return h | 1;
+	}
+
+	// the entry of k, -1 if it's not there. With insert the entry is taken if it's not there.
+	int find ( quint64 k, bool insert ) {
+		const unsigned int mask = ( 1 << PERIODICCACHE_BITS ) - 1;
+		for ( int p = 0; p < PERIODICCACHE_PROBES; ++p ) {
+			const unsigned int i = ( (unsigned int) ( k >> 32 ) + p ) & mask;
+			const quint64 present = keys[i].load( );
+			if ( present == k ) return i;
+			if ( present != 0 ) continue;
+			if ( !insert ) return -1;
+			// another generator can take the entry in the meantime, maybe for the same key
+			if ( keys[i].testAndSetRelaxed( 0, k ) || keys[i].load( ) == k ) return i;
+		}
+		return -1;
+	}
+
+	double invCell;
+	QAtomicInteger<quint64> keys[1 << PERIODICCACHE_BITS];
+	QAtomicInt counts[1 << PERIODICCACHE_BITS];
+};
+
+
+#endif // PERIODICCACHE_H
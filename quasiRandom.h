@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2010, Emilio Del Tessandoro
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY EMILIO DEL TESSANDORO o ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL EMILIO DEL TESSANDORO BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+
+
+#ifndef QUASIRANDOM_H
+#define QUASIRANDOM_H
+
+#include <QAtomicInteger>
+#include "random.h"
+
+// the digits in base 3 of the second coordinate, 3^30 points before it repeats
+#define HALTON_DIGITS3		30
+// the points are taken by the generators in blocks of this size
+#define QUASIRANDOM_BLOCK	256
+
+
+// The 2d Halton sequence (bases 2 and 3) with random digit scrambling: every digit of the
+// radical inverse is permuted by a permutation chosen for its position, so the two coordinates
+// lose the correlation and the regular patterns of the plain sequence, but the points stay
+// stratified. In base 2 the only permutation that changes something is the swap, that is a xor.
+// The index of the next point is shared by all the generators, each one takes a whole block
+// of indices with next(), so the threads never draw the same points. Without locks.
+class QuasiRandomSequence {
+public:
+	QuasiRandomSequence ( ) : index( 0 ) {
+		// the same of the default seed of the Buddha
+		Random generator;
+		scramble( generator );
+	}
+
+	// the tables are read by the generators, call it only when they are stopped or paused
+	void scramble ( Random& generator ) {
+		mask = ( (quint64) generator.integer( ) << 33 ) ^ ( (quint64) generator.integer( ) << 11 ) ^ generator.integer( );
+		for ( int d = 0; d < HALTON_DIGITS3; ++d ) {
+			digits3[d][0] = 0; digits3[d][1] = 1; digits3[d][2] = 2;
+			for ( int k = 2; k > 0; --k ) {
+				const int j = generator.integer( ) % ( k + 1 );
+				const unsigned char t = digits3[d][k];
+				digits3[d][k] = digits3[d][j];
+				digits3[d][j] = t;
+			}
+		}
+	}
+
+	// the sequence starts again from the first point, the scrambling doesn't change
+	void restart ( ) { index.store( 0 ); }
+
+	// the first index of a block of n points that nobody else will take
+	quint64 next ( unsigned int n ) { return index.fetchAndAddRelaxed( n ); }
+
+	// the point i of the sequence, in [0,1)^2
+	void point ( quint64 i, double& x, double& y ) const {
+		x = ( reverse( i ) ^ mask ) * ( 1.0 / 18446744073709551616.0 );
+
+		// all the digits must be permuted, also the zeros after the last one of i
+		double inverse = 1.0 / 3.0;
+		y = 0.0;
+		for ( int d = 0; d < HALTON_DIGITS3; ++d ) {
+			y += digits3[d][i % 3] * inverse;
+			inverse *= 1.0 / 3.0;
+			i /= 3;
+		}
+	}
+
+private:
+	QAtomicInteger<quint64> index;
+	quint64 mask;
+	unsigned char digits3[HALTON_DIGITS3][3];
+
+	static quint64 reverse ( quint64 v ) {
+		v = ( ( v >> 1 ) & 0x5555555555555555ULL ) | ( ( v & 0x5555555555555555ULL ) << 1 );
+		v = ( ( v >> 2 ) & 0x3333333333333333ULL ) | ( ( v & 0x3333333333333333ULL ) << 2 );
+		v = ( ( v >> 4 ) & 0x0F0F0F0F0F0F0F0FULL ) | ( ( v & 0x0F0F0F0F0F0F0F0FULL ) << 4 );
+		v = ( ( v >> 8 ) & 0x00FF00FF00FF00FFULL ) | ( ( v & 0x00FF00FF00FF00FFULL ) << 8 );
+		v = ( ( v >> 16 ) & 0x0000FFFF0000FFFFULL ) | ( ( v & 0x0000FFFF0000FFFFULL ) << 16 );
+		return ( v >> 32 ) | ( v << 32 );
+	}
+};
+
+
+#endif // QUASIRANDOM_H
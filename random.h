@@ -2,6 +2,9 @@
 #define RANDOM_H
 
 #include <stdint.h>
+#include <cmath>
+#include <cstring>
+#include "ziggurat.h"
 
 // RAND_MAX on windows is 0x7FFF
 #ifdef _WIN32
@@ -9,23 +12,165 @@
 #define RAND_MAX 0x7FFFFFFF
 #endif
 
+// the independent generators advanced together, and the numbers made every time
+#define RANDOM_LANES	4
+#define RANDOM_BUFFER	256
+
+// the xoshiro256** of Blackman and Vigna. The state is initialized with splitmix64 from a 64 bit
+// seed, then the generator can be split in streams that never overlap with jump(), that moves
+// ahead of 2^128 numbers, and longJump(), of 2^192. A run is reproducible from its seed:
+// the stream s of the seed is the same on every machine, see seed().
+// There are RANDOM_LANES generators, each one in its own substream, that fill together a buffer
+// of RANDOM_BUFFER numbers: the loop on the lanes is vectorized by the compiler.
 class Random {
 private:
-	uint32_t x, y, z, w;
+	uint64_t s[4][RANDOM_LANES];
+	uint64_t buffer[RANDOM_BUFFER];
+	int position;
+
+	static inline uint64_t rotl ( uint64_t x, int k ) {
+		return ( x << k ) | ( x >> ( 64 - k ) );
+	}
 
+	void refill ( ) {
+		for ( int j = 0; j < RANDOM_BUFFER; j += RANDOM_LANES ) {
+			for ( int l = 0; l < RANDOM_LANES; ++l ) {
+				buffer[j + l] = rotl( s[1][l] * 5, 7 ) * 9;
+				const uint64_t t = s[1][l] << 17;
+				s[2][l] ^= s[0][l];
+				s[3][l] ^= s[1][l];
+				s[1][l] ^= s[2][l];
+				s[0][l] ^= s[3][l];
+				s[2][l] ^= t;
+				s[3][l] = rotl( s[3][l], 45 );
+			}
+		}
+		position = 0;
+	}
+
+	inline uint64_t next ( ) {
+		if ( position == RANDOM_BUFFER ) refill( );
+		return buffer[position++];
+	}
+
+	// the high bits are the best ones
 	inline int32_t gen ( ) {
-		uint32_t t;
-		t = x ^ (x << 11);
-		x = y; y = z; z = w;
-		return ( w = w ^ (w >> 19) ^ (t ^ (t >> 8)) ) & RAND_MAX;
+		return (int32_t) ( next() >> 33 ) & RAND_MAX;
+	}
+
+	// one generator alone, for the jumps
+	static void step ( uint64_t* state ) {
+		const uint64_t t = state[1] << 17;
+		state[2] ^= state[0];
+		state[3] ^= state[1];
+		state[1] ^= state[2];
+		state[0] ^= state[3];
+		state[2] ^= t;
+		state[3] = rotl( state[3], 45 );
+	}
+
+	static void jump ( uint64_t* state, const uint64_t* polynomial ) {
+		uint64_t t[4] = { 0, 0, 0, 0 };
+		for ( int i = 0; i < 4; ++i ) {
+			for ( int b = 0; b < 64; ++b ) {
+				if ( polynomial[i] & ( (uint64_t) 1 << b ) ) {
+					t[0] ^= state[0]; t[1] ^= state[1]; t[2] ^= state[2]; t[3] ^= state[3];
+				}
+				step( state );
+			}
+		}
+		state[0] = t[0]; state[1] = t[1]; state[2] = t[2]; state[3] = t[3];
+	}
+
+	// equivalent to 2^128 numbers
+	static void jump ( uint64_t* state ) {
+		static const uint64_t polynomial[4] = { 0x180EC6D33CFD0ABAULL, 0xD5A61266F0C9392CULL,
+							0xA9582618E03FC9AAULL, 0x39ABDC4529B1661CULL };
+		jump( state, polynomial );
+	}
+
+	// equivalent to 2^192 numbers
+	static void longJump ( uint64_t* state ) {
+		static const uint64_t polynomial[4] = { 0x76E15D3EFEFDCBBFULL, 0xC5004E441C522FB3ULL,
+							0x77710069854EE241ULL, 0x39109BB02ACBE635ULL };
+		jump( state, polynomial );
+	}
+
+	// the jumps are linear in the bits of the state, so a matrix of them (the images of the
+	// 256 bits, as states) does many jumps at once
+	typedef uint64_t JumpMatrix[256][4];
+
+	static void apply ( const JumpMatrix m, const uint64_t* state, uint64_t* out ) {
+		uint64_t t[4] = { 0, 0, 0, 0 };
+		for ( int b = 0; b < 256; ++b ) {
+			if ( state[b >> 6] & ( (uint64_t) 1 << ( b & 63 ) ) ) {
+				t[0] ^= m[b][0]; t[1] ^= m[b][1]; t[2] ^= m[b][2]; t[3] ^= m[b][3];
+			}
+		}
+		out[0] = t[0]; out[1] = t[1]; out[2] = t[2]; out[3] = t[3];
+	}
+
+	// n long jumps squaring the matrix of one, so they cost log(n) and not n: the stream
+	// comes from the GUI and can be any number. The squarings cost like some thousands of
+	// jumps, so the small streams are done one jump at a time.
+	static void longJumps ( uint64_t* state, unsigned int n ) {
+		if ( n < 8192 ) {
+			for ( unsigned int i = 0; i < n; ++i ) longJump( state );
+			return;
+		}
+		JumpMatrix m, square;
+		for ( int b = 0; b < 256; ++b ) {
+			m[b][0] = m[b][1] = m[b][2] = m[b][3] = 0;
+			m[b][b >> 6] = (uint64_t) 1 << ( b & 63 );
+			longJump( m[b] );
+		}
+		while ( 1 ) {
+			if ( n & 1 ) apply( m, state, state );
+			if ( ( n >>= 1 ) == 0 ) return;
+			for ( int b = 0; b < 256; ++b ) apply( m, m[b], square[b] );
+			memcpy( m, square, sizeof( m ) );
+		}
+	}
+
+	// a sample of the ziggurat z, -1 when it falls in the tail. The strip is in the low
+	// bits and the position in the 53 high ones, sign is 1 or -1 from the bit ZIGGURAT_BITS
+	// that's not used by them (without branches, it's not predictable).
+	inline double ziggurat ( const Ziggurat& z, double (*density)( double ), double& sign ) {
+		while ( 1 ) {
+			const uint64_t bits = next();
+			const int i = bits & ( ZIGGURAT_LAYERS - 1 );
+			const double x = (int64_t) ( bits >> 11 ) * ( 1.0 / 9007199254740992.0 ) * z.x[i];
+			sign = 1.0 - (double) ( ( bits >> ( ZIGGURAT_BITS - 1 ) ) & 2 );
+			if ( x < z.x[i + 1] ) return x;
+			if ( i == 0 ) return -1.0;
+			if ( z.f[i] + real() * ( z.f[i + 1] - z.f[i] ) < density( x ) ) return x;
+		}
 	}
 
 public:
-	Random ( uint32_t seed = 123456789 ) {
-		x = seed;
-		y = 362436069;
-		z = 521288629;
-		w = 88675123;
+	Random ( uint64_t seed = 123456789 ) {
+		this->seed( seed );
+	}
+
+	// the stream of the seed: stream selects a block of 2^192 numbers (a process or a
+	// machine of the same run) and substream one of 2^128 inside it (a generator). The lanes
+	// take the substreams from substream * RANDOM_LANES.
+	void seed ( uint64_t seed, unsigned int stream = 0, unsigned int substream = 0 ) {
+		uint64_t state[4];
+		// splitmix64, so also the similar seeds give very different states
+		for ( int i = 0; i < 4; ++i ) {
+			uint64_t z = ( seed += 0x9E3779B97F4A7C15ULL );
+			z = ( z ^ ( z >> 30 ) ) * 0xBF58476D1CE4E5B9ULL;
+			z = ( z ^ ( z >> 27 ) ) * 0x94D049BB133111EBULL;
+			state[i] = z ^ ( z >> 31 );
+		}
+		longJumps( state, stream );
+		for ( unsigned int i = 0; i < substream * RANDOM_LANES; ++i ) jump( state );
+		for ( int l = 0; l < RANDOM_LANES; ++l ) {
+			for ( int i = 0; i < 4; ++i ) s[i][l] = state[i];
+			jump( state );
+		}
+		position = RANDOM_BUFFER;
 	}
 
 	// get uniformly an integer in [0,RAND_MAX)
@@ -35,22 +180,22 @@ public:
 
 	// get uniformly a real in [0,1)
 	double real ( ) {
-		return gen() / (double) RAND_MAX;
+		return (int64_t) ( next() >> 11 ) * ( 1.0 / 9007199254740992.0 );
 	}
 
-	// get uniformly a real in (-1,1)
+	// get uniformly a real in [-1,1)
 	double realnegative ( ) {
-		return ( gen() << 1 ) / (double) RAND_MAX;
+		return (int64_t) ( next() >> 11 ) * ( 1.0 / 4503599627370496.0 ) - 1.0;
 	}
 
 	// get uniformly a real in [0,2)
 	double real2 ( ) {
-		return gen() / RAND_MAX * 2.0;
+		return real() * 2.0;
 	}
 
-	// get uniformly a real in (-2,2)
+	// get uniformly a real in [-2,2)
 	double real2negative ( ) {
-		return ( gen() << 1 ) / RAND_MAX * 2.0;
+		return realnegative() * 2.0;
 	}
 
 	// get uniformly a real in the unit disk
@@ -63,7 +208,7 @@ public:
 			y = realnegative();
 
 			s = x * x + y * y;
-			if ( s <= 1.0 ) return s;
+			if ( s <= 1.0 && s > 0.0 ) return s;
 		}
 
 		// all generators except mt19937 can generate artifacts with the following
@@ -76,51 +221,59 @@ public:
 		y = r * sin( phi );*/
 	}
 
+	// a real normally distributed (mean = 0, variance = 1) with the ziggurat, log and sqrt
+	// are needed only in the tail, that is 1 time in some thousands
+	double normal ( ) {
+		double sign;
+		double x = ziggurat( gaussianZiggurat, gaussianDensity, sign );
+		if ( x < 0.0 ) {
+			// Marsaglia's method for the tail after r
+			const double r = gaussianZiggurat.x[1];
+			double a, b;
+			do {
+				a = -log( 1.0 - real() ) / r;
+				b = -log( 1.0 - real() );
+			} while ( b + b < a * a );
+			x = r + a;
+		}
+		return sign * x;
+	}
+
 	// generate a two dimension random point normally distributed (mean = 0, variance = 1)
 	void gaussian ( double& x, double& y ) {
-		// this is the exact one (Marsaglia polar method applied to Box-Muller transform)
-		double s = realdisk( x, y );
-		double factor = sqrt( -2.0 * log( s ) / s );
-		x = x * factor;
-		y = y * factor;
-
-		// this is approximated and uses the central limit thorem
-		/*int64_t tmp = 0;
-		for ( int i = 0; i < 12; ++i ) tmp += gen();
-		x = tmp / (double) RAND_MAX - 6.0; tmp = 0;
-		for ( int i = 0; i < 12; ++i ) tmp += gen();
-		y = tmp / (double) RAND_MAX - 6.0;*/
-
+		// the same of the Marsaglia polar method applied to Box-Muller transform, that
+		// needs a log and a sqrt every time
+		x = normal();
+		y = normal();
 	}
 
 	void gaussian ( double& x, double& y, double radius ) {
-		double s = realdisk( x, y );
-		double factor = sqrt( -2.0 * log( s ) / s ) * radius;
-		x = x * factor;
-		y = y * factor;
+		x = normal() * radius;
+		y = normal() * radius;
 	}
 
 	// generate a two dimension random point exponentially distributed
 	// (actually this is not really exponential i think but hower is much more
 	// dense aroun the origin than the gaussian mutation)
+	// The radius is -log( s ) / sqrt( s ) with s uniform, taken from the ziggurat, and the
+	// direction is the one of a point of the disk. Only a sqrt in the common case.
 	void exponential ( double& x, double& y ) {
-		double s = realdisk( x, y );
-		double factor = -log( s ) / s;
-		x = x * factor;
-		y = y * factor;
+		exponential( x, y, 1.0 );
 	}
 
 	void exponential ( double& x, double& y, double radius ) {
+		double sign;
+		double r = ziggurat( radialZiggurat, radialDensity, sign );
+		if ( r < 0.0 ) {
+			// after the first strip t is exponential too, it has no memory
+			const double t = radialTailExponent - log( 1.0 - real() );
+			r = t * exp( 0.5 * t );
+		}
 		double s = realdisk( x, y );
-		double factor = -log( s ) / s * radius;
+		double factor = r / sqrt( s ) * radius;
 		x = x * factor;
 		y = y * factor;
 	}
-
-	// change the seed
-	void seed ( uint32_t seed ) {
-		x = seed;
-	}
 };
 
 
@@ -176,9 +176,8 @@ void RenderWindow::mouseReleaseEvent(QMouseEvent *event) {
 		zoom( scale );
 		// TODO ugly, this has been just set in the previous call
 		//parent->putValues( b->cre + dx / b->scale, b->cim - dy / b->scale, parent->getScale() );
-		parent->setCre( b->cre + dx / b->scale );
 		//parent->setCim( b->cim + dy / b->scale );
-		parent->setCim( b->cim - dy / b->scale );
+		parent->moveCenter( dx / b->scale, -dy / b->scale );
 		parent->modelToGUI();
 		parent->sendValues( true );
 		disabledDrawing = true;
@@ -266,8 +265,7 @@ void RenderWindow::scroll ( int dx, int dy ) {
 
 	imageOffset = QPoint( 0, 0 );
 	//parent->putValues( b->cre + dx / b->scale, b->cim - dy / b->scale, parent->getScale() );
-	parent->setCre( b->cre + dx / b->scale );
-	parent->setCim( b->cim - dy / b->scale );
+	parent->moveCenter( dx / b->scale, -dy / b->scale );
 	parent->modelToGUI();
 }
 
@@ -281,8 +279,7 @@ void RenderWindow::zoom ( double factor, int cutdx, int cutdy ) {
 	QPoint newCentre( multiplier * 2.0 * cutdx, multiplier * 2.0 * cutdy );
 	
 	//parent->putValues( b->cre + newCentre.x() / b->scale, b->cim - newCentre.y() / b->scale, b->scale * factor );
-	parent->setCre( b->cre + newCentre.x() / b->scale );
-	parent->setCim( b->cim - newCentre.y() / b->scale );
+	parent->moveCenter( newCentre.x() / b->scale, -newCentre.y() / b->scale );
 	parent->setScale( b->scale * factor );
     parent->modelToGUI();
 }
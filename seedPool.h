@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2010, Emilio Del Tessandoro
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY EMILIO DEL TESSANDORO o ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL EMILIO DEL TESSANDORO BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+
+#ifndef SEEDPOOL_H
+#define SEEDPOOL_H
+
+#include <cstring>
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include "random.h"
+
+// the seeds kept, the oldest are overwritten
+#define SEEDPOOL_SIZE		256
+// probability that a new chain starts from a seed of the pool instead of searching
+#define SEEDPOOL_REUSE		0.5
+
+
+// The points where the metropolis chains of all the generators ended, with their selected
+// contribute and max, so a new chain can start from a good orbit found by another thread
+// instead of searching it again with findPoint().
+// It's a ring of slots without locks: every slot has a sequence number that is odd while
+// the slot is written (a seqlock), the readers try again another time if they find it
+// changed. When only the iterations change the seeds become hints for the search: their
+// position is still good but their contribute and max are not valid anymore, see clear().
+// When the view, the fractal or the precision change the pool is emptied, see reset().
+class SeedPool {
+public:
+	SeedPool ( ) : head( 0 ), epoch( 1 ) { }
+
+	// forgets contribute and max of all the seeds
+	void clear ( ) { epoch.fetchAndAddOrdered( 1 ); }
+
+	// forgets all the seeds, the generators must not be running
+	void reset ( ) {
+		for ( int i = 0; i < SEEDPOOL_SIZE; ++i ) ring[i].sequence.store( 0 );
+		head.store( 0 );
+		clear( );
+	}
+
+	void publish ( double re, double im, unsigned int count, int max ) {
+		Slot& s = ring[(unsigned int) head.fetchAndAddRelaxed( 1 ) % SEEDPOOL_SIZE];
+		// if another thread is writing the same slot this seed is simply lost
+		const int sequence = s.sequence.loadAcquire( );
+		if ( ( sequence & 1 ) || !s.sequence.testAndSetAcquire( sequence, sequence + 1 ) ) return;
+		s.re.store( bits( re ) );
+		s.im.store( bits( im ) );
+		s.count.store( count );
+		s.max.store( max );
+		s.epoch.store( epoch.load( ) );
+		s.sequence.storeRelease( sequence + 2 );
+	}
+
+	// a random seed, false if there is none or it was being written. fresh is false for
+	// the seeds of a previous view, then count and max must not be used.
+	bool sample ( Random& generator, double& re, double& im, unsigned int& count, int& max, bool& fresh ) {
+		const unsigned int published = (unsigned int) head.load( );
+		if ( published == 0 ) return false;
+		const Slot& s = ring[generator.integer( ) % ( published < SEEDPOOL_SIZE ? published : SEEDPOOL_SIZE )];
+
+		// the acquire loads keep the order of the reads up to the second test
+		const int sequence = s.sequence.loadAcquire( );
+		if ( sequence == 0 || ( sequence & 1 ) ) return false;
+		re = real( s.re.loadAcquire( ) );
+		im = real( s.im.loadAcquire( ) );
+		count = s.count.loadAcquire( );
+		max = s.max.loadAcquire( );
+		fresh = s.epoch.loadAcquire( ) == epoch.load( );
+		return s.sequence.loadAcquire( ) == sequence;
+	}
+
+private:
+	struct Slot {
+		QAtomicInt sequence;
+		QAtomicInteger<quint64> re, im;
+		QAtomicInt count, max, epoch;
+	};
+
+	static quint64 bits ( double d ) { quint64 b; memcpy( &b, &d, sizeof( b ) ); return b; }
+	static double real ( quint64 b ) { double d; memcpy( &d, &b, sizeof( d ) ); return d; }
+
+	Slot ring[SEEDPOOL_SIZE];
+	QAtomicInt head, epoch;
+};
+
+#endif
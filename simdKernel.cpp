@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2010, Emilio Del Tessandoro
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY EMILIO DEL TESSANDORO o ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL EMILIO DEL TESSANDORO BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+
+#include "simdKernel.h"
+#include "doubleDouble.h"
+#include <emmintrin.h>
+
+#if defined( _MSC_VER )
+#include <intrin.h>
+#elif defined( __GNUC__ )
+#include <cpuid.h>
+#endif
+
+
+// two lanes, SSE2 is always there on the machines we compile for
+struct SSE2Lanes {
+	typedef double scalar;
+	typedef __m128d reg;
+	typedef __m128d mask;
+	enum { width = 2 };
+
+	static inline reg set1 ( double a ) { return _mm_set1_pd( a ); }
+	static inline reg load ( const double* p ) { return _mm_loadu_pd( p ); }
+	static inline void store ( double* p, reg a ) { _mm_storeu_pd( p, a ); }
+	static inline reg add ( reg a, reg b ) { return _mm_add_pd( a, b ); }
+	static inline reg sub ( reg a, reg b ) { return _mm_sub_pd( a, b ); }
+	static inline reg mul ( reg a, reg b ) { return _mm_mul_pd( a, b ); }
+	static inline mask lt ( reg a, reg b ) { return _mm_cmplt_pd( a, b ); }
+	static inline mask le ( reg a, reg b ) { return _mm_cmple_pd( a, b ); }
+	static inline mask eq ( reg a, reg b ) { return _mm_cmpeq_pd( a, b ); }
+	static inline mask andm ( mask a, mask b ) { return _mm_and_pd( a, b ); }
+	static inline mask orm ( mask a, mask b ) { return _mm_or_pd( a, b ); }
+	static inline mask andnotm ( mask a, mask b ) { return _mm_andnot_pd( a, b ); }
+	static inline reg select ( mask m, reg a, reg b ) { return _mm_or_pd( _mm_and_pd( m, a ), _mm_andnot_pd( m, b ) ); }
+	static inline reg addIf ( reg a, mask m, reg b ) { return _mm_add_pd( a, _mm_and_pd( m, b ) ); }
+	static inline mask fromBits ( unsigned int bits ) {
+		const int h = ( bits & 2 ) ? -1 : 0, l = ( bits & 1 ) ? -1 : 0;
+		return _mm_castsi128_pd( _mm_set_epi32( h, h, l, l ) );
+	}
+	static inline unsigned int toBits ( mask m ) { return _mm_movemask_pd( m ); }
+
+	// for the projection
+	static inline void deinterleave ( const double* p, reg& re, reg& im ) {
+		const __m128d a = _mm_loadu_pd( p ), b = _mm_loadu_pd( p + 2 );
+		re = _mm_unpacklo_pd( a, b );
+		im = _mm_unpackhi_pd( a, b );
+	}
+	static inline void toIndex ( int* p, reg a ) { _mm_storel_epi64( (__m128i*) p, _mm_cvttpd_epi32( a ) ); }
+};
+
+// four lanes in single precision
+struct SSE2FloatLanes {
+	typedef float scalar;
+	typedef __m128 reg;
+	typedef __m128 mask;
+	enum { width = 4 };
+
+	static inline reg set1 ( float a ) { return _mm_set1_ps( a ); }
+	static inline reg load ( const float* p ) { return _mm_loadu_ps( p ); }
+	static inline void store ( float* p, reg a ) { _mm_storeu_ps( p, a ); }
+	static inline reg add ( reg a, reg b ) { return _mm_add_ps( a, b ); }
+	static inline reg sub ( reg a, reg b ) { return _mm_sub_ps( a, b ); }
+	static inline reg mul ( reg a, reg b ) { return _mm_mul_ps( a, b ); }
+	static inline mask lt ( reg a, reg b ) { return _mm_cmplt_ps( a, b ); }
+	static inline mask le ( reg a, reg b ) { return _mm_cmple_ps( a, b ); }
+	static inline mask eq ( reg a, reg b ) { return _mm_cmpeq_ps( a, b ); }
+	static inline mask andm ( mask a, mask b ) { return _mm_and_ps( a, b ); }
+	static inline mask orm ( mask a, mask b ) { return _mm_or_ps( a, b ); }
+	static inline mask andnotm ( mask a, mask b ) { return _mm_andnot_ps( a, b ); }
+	static inline reg select ( mask m, reg a, reg b ) { return _mm_or_ps( _mm_and_ps( m, a ), _mm_andnot_ps( m, b ) ); }
+	static inline reg addIf ( reg a, mask m, reg b ) { return _mm_add_ps( a, _mm_and_ps( m, b ) ); }
+	static inline mask fromBits ( unsigned int bits ) {
+		return _mm_castsi128_ps( _mm_set_epi32( ( bits & 8 ) ? -1 : 0, ( bits & 4 ) ? -1 : 0,
+		                                        ( bits & 2 ) ? -1 : 0, ( bits & 1 ) ? -1 : 0 ) );
+	}
+	static inline unsigned int toBits ( mask m ) { return _mm_movemask_ps( m ); }
+};
+
+
+EvaluateLanesFunction selectLanesScalar ( Formula formula, bool bounded, bool singlePrecision ) {
+	return singlePrecision ? lanesFor< ScalarLane<float> >( formula, bounded ) : lanesFor< ScalarLane<double> >( formula, bounded );
+}
+
+EvaluateLanesFunction selectLanesSSE2 ( Formula formula, bool bounded, bool singlePrecision ) {
+	return singlePrecision ? lanesFor<SSE2FloatLanes>( formula, bounded ) : lanesFor<SSE2Lanes>( formula, bounded );
+}
+
+EvaluateDeepFunction selectDeepLanesScalar ( bool bounded ) {
+	return deepLanesFor< ScalarLane<double> >( bounded );
+}
+
+EvaluateDeepFunction selectDeepLanesSSE2 ( bool bounded ) {
+	return deepLanesFor<SSE2Lanes>( bounded );
+}
+
+
+
+int projectPointsScalar ( const ProjectView& v, const double* points, int n, unsigned int* pixels ) {
+	int count = 0;
+	for ( int k = 0; k < n; ++k ) {
+		const double re = points[2 * k], im = points[2 * k + 1];
+		if ( re < v.minre || re > v.maxre ) continue;
+
+		const unsigned int x = ( re - v.minre ) * v.scale;
+		if ( im > v.minim && im < v.maxim )
+			pixels[count++] = tiledPixel( x, ( v.maxim - im ) * v.scale, v.tiles );
+		if ( v.symmetric && -im > v.minim && -im < v.maxim )
+			pixels[count++] = tiledPixel( x, ( v.maxim + im ) * v.scale, v.tiles );
+	}
+	return count;
+}
+
+int projectPointsSSE2 ( const ProjectView& v, const double* points, int n, unsigned int* pixels ) {
+	return projectPointsKernel<SSE2Lanes>( v, points, n, pixels );
+}
+
+
+void addToDoubleDouble ( double ahi, double alo, double b, double& hi, double& lo ) {
+	const DD< ScalarLane<double> > r = ddAdd< ScalarLane<double> >( ddSet1< ScalarLane<double> >( ahi, alo ),
+	                                                               ddSet1< ScalarLane<double> >( b, 0.0 ) );
+	hi = r.hi;
+	lo = r.lo;
+}
+
+void deepOrbitStart ( const DeepView& v, double offre, double offim, DeepOrbit& o ) {
+	addToDoubleDouble( v.cre, v.creLo, offre, o.cr, o.crLo );
+	addToDoubleDouble( v.cim, v.cimLo, offim, o.ci, o.ciLo );
+	o.zr = o.cr; o.zrLo = o.crLo;
+	o.zi = o.ci; o.ziLo = o.ciLo;
+}
+
+void deepOrbitNext ( const DeepView& v, DeepOrbit& o, int n, double* re, double* im, double* conjim ) {
+	typedef ScalarLane<double> S;
+	const DD<S> centerre = ddSet1<S>( v.cre, v.creLo ), centerim = ddSet1<S>( v.cim, v.cimLo );
+	const DD<S> cr = ddSet1<S>( o.cr, o.crLo ), ci = ddSet1<S>( o.ci, o.ciLo );
+	DD<S> zr = ddSet1<S>( o.zr, o.zrLo ), zi = ddSet1<S>( o.zi, o.ziLo );
+
+	for ( int k = 0; k < n; ++k ) {
+		re[k] = ddSub<S>( zr, centerre ).hi;
+		im[k] = ddSub<S>( zi, centerim ).hi;
+		conjim[k] = -ddAdd<S>( zi, centerim ).hi;
+
+		const DD<S> t = ddAdd<S>( ddSub<S>( ddSqr<S>( zr ), ddSqr<S>( zi ) ), cr );
+		zi = ddAdd<S>( ddTwice<S>( ddMul<S>( zr, zi ) ), ci );
+		zr = t;
+	}
+
+	o.zr = zr.hi; o.zrLo = zr.lo;
+	o.zi = zi.hi; o.ziLo = zi.lo;
+}
+
+
+
+// cpuid and xgetbv. The instruction set must be supported by the cpu and the OS must
+// save the wider registers on context switches, otherwise we crash anyway.
+static void cpuid ( int leaf, int subleaf, unsigned int regs[4] ) {
+#if defined( _MSC_VER )
+	int r[4];
+	__cpuidex( r, leaf, subleaf );
+	for ( int i = 0; i < 4; ++i ) regs[i] = r[i];
+#elif defined( __GNUC__ )
+	__cpuid_count( leaf, subleaf, regs[0], regs[1], regs[2], regs[3] );
+#else
+	regs[0] = regs[1] = regs[2] = regs[3] = 0;
+#endif
+}
+
+static unsigned long long xgetbv ( ) {
+#if defined( _MSC_VER )
+	return _xgetbv( 0 );
+#elif defined( __GNUC__ )
+	unsigned int eax, edx;
+	__asm__ ( "xgetbv" : "=a" ( eax ), "=d" ( edx ) : "c" ( 0 ) );
+	return ( (unsigned long long) edx << 32 ) | eax;
+#else
+	return 0;
+#endif
+}
+
+// the widest instruction set we can use: 2 for AVX-512, 1 for AVX2, 0 for SSE2
+static int instructionSet ( ) {
+	unsigned int regs[4];
+	cpuid( 0, 0, regs );
+	const unsigned int maxLeaf = regs[0];
+
+	cpuid( 1, 0, regs );
+	const bool osxsave = ( regs[2] >> 27 ) & 1;
+	const bool avx = ( regs[2] >> 28 ) & 1;
+	const bool fma = ( regs[2] >> 12 ) & 1;
+	bool avx2 = false, avx512 = false;
+
+	if ( osxsave && avx && maxLeaf >= 7 ) {
+		const unsigned long long xcr0 = xgetbv( );
+		cpuid( 7, 0, regs );
+		// xmm and ymm state for avx, also opmask and zmm state for avx-512
+		avx2 = ( xcr0 & 0x06 ) == 0x06 && fma && ( ( regs[1] >> 5 ) & 1 );
+		avx512 = ( xcr0 & 0xE6 ) == 0xE6 && avx2 && ( ( regs[1] >> 16 ) & 1 );
+	}
+
+	return avx512 ? 2 : avx2 ? 1 : 0;
+}
+
+EvaluateLanesFunction selectEvaluateLanes ( int& laneWidth, bool singlePrecision, Formula formula, bool bounded ) {
+	const int isa = instructionSet( );
+
+	// in single precision there are twice the lanes
+	if ( isa == 2 ) {
+		laneWidth = singlePrecision ? 16 : 8;
+		return selectLanesAVX512( formula, bounded, singlePrecision );
+	}
+	if ( isa == 1 ) {
+		laneWidth = singlePrecision ? 8 : 4;
+		return selectLanesAVX2( formula, bounded, singlePrecision );
+	}
+	laneWidth = singlePrecision ? 4 : 2;
+	return selectLanesSSE2( formula, bounded, singlePrecision );
+}
+
+ProjectPointsFunction selectProjectPoints ( ) {
+	const int isa = instructionSet( );
+	return isa == 2 ? projectPointsAVX512 : isa == 1 ? projectPointsAVX2 : projectPointsSSE2;
+}
+
+// SSE2 has only the signed maximum of 16 bits: with the sign bit flipped the order is the same
+unsigned short planeMaximumSSE2 ( const unsigned short* plane, unsigned int n ) {
+	const __m128i flip = _mm_set1_epi16( (short) 0x8000 );
+	__m128i m0 = flip, m1 = flip, m2 = flip, m3 = flip;
+	unsigned int i = 0;
+	for ( ; i + 32 <= n; i += 32 ) {
+		m0 = _mm_max_epi16( m0, _mm_xor_si128( _mm_load_si128( (const __m128i*) ( plane + i ) ), flip ) );
+		m1 = _mm_max_epi16( m1, _mm_xor_si128( _mm_load_si128( (const __m128i*) ( plane + i + 8 ) ), flip ) );
+		m2 = _mm_max_epi16( m2, _mm_xor_si128( _mm_load_si128( (const __m128i*) ( plane + i + 16 ) ), flip ) );
+		m3 = _mm_max_epi16( m3, _mm_xor_si128( _mm_load_si128( (const __m128i*) ( plane + i + 24 ) ), flip ) );
+	}
+
+	unsigned short lanes[8];
+	_mm_storeu_si128( (__m128i*) lanes, _mm_xor_si128( _mm_max_epi16( _mm_max_epi16( m0, m1 ), _mm_max_epi16( m2, m3 ) ), flip ) );
+	unsigned short m = 0;
+	for ( int k = 0; k < 8; ++k ) m = std::max( m, lanes[k] );
+	for ( ; i < n; ++i ) m = std::max( m, plane[i] );
+	return m;
+}
+
+PlaneMaximumFunction selectPlaneMaximum ( ) {
+	return instructionSet( ) > 0 ? planeMaximumAVX2 : planeMaximumSSE2;
+}
+
+EvaluateDeepFunction selectEvaluateDeep ( int& laneWidth, bool bounded ) {
+	const int isa = instructionSet( );
+
+	laneWidth = isa == 2 ? 8 : isa == 1 ? 4 : 2;
+	return isa == 2 ? selectDeepLanesAVX512( bounded ) : isa == 1 ? selectDeepLanesAVX2( bounded ) : selectDeepLanesSSE2( bounded );
+}
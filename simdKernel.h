@@ -0,0 +1,562 @@
+/*
+ * Copyright (c) 2010, Emilio Del Tessandoro
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY EMILIO DEL TESSANDORO o ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL EMILIO DEL TESSANDORO BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef SIMDKERNEL_H
+#define SIMDKERNEL_H
+
+#include <cfloat>
+#include "interiorMap.h"
+#include "formula.h"
+#include "histogram.h"
+
+#define STEP		16
+
+// with EVALUATEBLOCK > 1 the lane kernels of the Buddhabrot first find how every orbit ends
+// doing only the iterations, in blocks of this size with the escape and periodicity tests at
+// the end of the block, then compute again the escaping ones with all the tests, see
+// evaluateLanesBlocked(). 1 is the kernel with all the tests at every iteration.
+// On points near the border (the ones the chains visit) 8 was 20-40% faster with scalars,
+// SSE2 and AVX2 and about the same with AVX-512; on points taken uniformly, that escape in a
+// few iterations, it was up to 30% slower, but these are fast anyway. 4 - 16
+#define EVALUATEBLOCK	8
+
+// the part of the Buddha state the kernels need. I copy it in a plain struct so the
+// kernels don't depend on Qt and so the values stay in registers/L1 during the loop.
+struct KernelView {
+	double minre, maxre, minim, maxim;
+	double cre, cim;
+	unsigned int high;
+	InteriorView interior;		// without cells if there is no map
+	unsigned int periodicityStep;	// see Buddha::updatePeriodicity()
+	double periodicityTolerance;
+};
+
+// what BuddhaGenerator::evaluate() gives back for one point, apart from the sequence
+struct LaneResult {
+	int max;
+	unsigned int contribute;
+	unsigned int calculated;
+	double centerDistance;
+};
+
+// evaluates n points (cr[k], ci[k]) and fills out[k]. The orbits are not saved, this is
+// used where only the escape and the contribute matter (findPoint for example).
+typedef void (*EvaluateLanesFunction) ( const KernelView& v, const double* cr, const double* ci,
+					int n, LaneResult* out );
+
+// the kernels of every instruction set for a formula and for the orbits that are drawn (bounded
+// is the anti-Buddhabrot). In single precision there are twice the lanes, but the iterations
+// are counted in float so they can be used only with less than FLOAT_MAX_ITERATIONS iterations.
+EvaluateLanesFunction selectLanesScalar ( Formula formula, bool bounded, bool singlePrecision );
+EvaluateLanesFunction selectLanesSSE2 ( Formula formula, bool bounded, bool singlePrecision );
+EvaluateLanesFunction selectLanesAVX2 ( Formula formula, bool bounded, bool singlePrecision );
+EvaluateLanesFunction selectLanesAVX512 ( Formula formula, bool bounded, bool singlePrecision );
+
+#define FLOAT_MAX_ITERATIONS	( 1 << 24 )
+
+// picks at runtime the widest instruction set supported by the cpu (and the OS).
+// laneWidth is how many points the chosen kernel advances together.
+EvaluateLanesFunction selectEvaluateLanes ( int& laneWidth, bool singlePrecision = false,
+					    Formula formula = MANDELBROT_FORMULA, bool bounded = false );
+
+// the biggest lane width between all the kernels, useful for sizing the arrays
+#define MAXLANES	16
+
+
+
+// the part of the view needed to put the orbits on the screen
+struct ProjectView {
+	double minre, maxre, minim, maxim;
+	double scale;
+	unsigned int tiles;	// the tiles in a row of the histogram
+	bool symmetric;		// if the simmetric points are drawn too, see Formula
+};
+
+// projects n points (re and im interleaved, like a complex<double> array) on the screen
+// with the same tests of BuddhaGenerator::drawPoint(). For every point, and its simmetric
+// if v.symmetric, that falls in the window the offset of its pixel in the histogram (see
+// tiledPixel()) is written in pixels, that must have space for 2n offsets. Gives back how many offsets were written, in no particular order.
+typedef int (*ProjectPointsFunction) ( const ProjectView& v, const double* points, int n, unsigned int* pixels );
+
+int projectPointsScalar ( const ProjectView& v, const double* points, int n, unsigned int* pixels );
+int projectPointsSSE2 ( const ProjectView& v, const double* points, int n, unsigned int* pixels );
+int projectPointsAVX2 ( const ProjectView& v, const double* points, int n, unsigned int* pixels );
+int projectPointsAVX512 ( const ProjectView& v, const double* points, int n, unsigned int* pixels );
+
+ProjectPointsFunction selectProjectPoints ( );
+
+
+// the maximum of n counters of a plane of the Histogram, aligned to HISTOGRAM_ALIGNMENT.
+// There is no AVX-512 version: the 16-bit maximum needs AVX-512 BW, that we don't check.
+typedef unsigned short (*PlaneMaximumFunction) ( const unsigned short* plane, unsigned int n );
+
+unsigned short planeMaximumSSE2 ( const unsigned short* plane, unsigned int n );
+unsigned short planeMaximumAVX2 ( const unsigned short* plane, unsigned int n );
+
+PlaneMaximumFunction selectPlaneMaximum ( );
+
+
+// the instances of the kernels for the vector types of an instruction set, see selectLanesSSE2()
+template <class V, class F, class A>
+void evaluateLanesInstance ( const KernelView& v, const double* cr, const double* ci, int n, LaneResult* out );
+
+template <class V>
+inline EvaluateLanesFunction lanesFor ( Formula formula, bool bounded ) {
+	switch ( formula ) {
+	case MULTIBROT3_FORMULA:
+		return bounded ? &evaluateLanesInstance<V, Multibrot3Formula, BoundedOrbits>
+			       : &evaluateLanesInstance<V, Multibrot3Formula, EscapingOrbits>;
+	case BURNINGSHIP_FORMULA:
+		return bounded ? &evaluateLanesInstance<V, BurningShipFormula, BoundedOrbits>
+			       : &evaluateLanesInstance<V, BurningShipFormula, EscapingOrbits>;
+	default:
+		return bounded ? &evaluateLanesInstance<V, MandelbrotFormula, BoundedOrbits>
+			       : &evaluateLanesInstance<V, MandelbrotFormula, EscapingOrbits>;
+	}
+}
+
+
+
+// For the deep zoom (past the double precision) the center of the window is a double-double
+// number: cre + creLo. The points are given as double offsets from it, and the orbits are
+// iterated in double-double (see doubleDouble.h).
+struct DeepView {
+	double cre, creLo, cim, cimLo;
+	double halfre, halfim;		// half of the window sizes
+	double tolerance;		// squared distance for the periodicity check
+	unsigned int periodicityStep;
+	unsigned int high;
+	InteriorView interior;		// without cells if there is no map
+};
+
+typedef void (*EvaluateDeepFunction) ( const DeepView& v, const double* offre, const double* offim,
+				       int n, LaneResult* out );
+
+// only for the Mandelbrot formula
+EvaluateDeepFunction selectDeepLanesScalar ( bool bounded );
+EvaluateDeepFunction selectDeepLanesSSE2 ( bool bounded );
+EvaluateDeepFunction selectDeepLanesAVX2 ( bool bounded );
+EvaluateDeepFunction selectDeepLanesAVX512 ( bool bounded );
+
+EvaluateDeepFunction selectEvaluateDeep ( int& laneWidth, bool bounded = false );
+
+// the state of a deep orbit while it's drawn
+struct DeepOrbit {
+	double zr, zrLo, zi, ziLo;
+	double cr, crLo, ci, ciLo;
+};
+
+// starts the orbit of the point center + (offre, offim)
+void deepOrbitStart ( const DeepView& v, double offre, double offim, DeepOrbit& o );
+
+// computes the next n points of the orbit, and gives their offsets from the center: re, im
+// for the point and conjim for the imaginary part of its simmetric point.
+void deepOrbitNext ( const DeepView& v, DeepOrbit& o, int n, double* re, double* im, double* conjim );
+
+// (hi, lo) = (ahi, alo) + b, in double-double. Here because it must be compiled with strict
+// floating point semantics, like the kernels.
+void addToDoubleDouble ( double ahi, double alo, double b, double& hi, double& lo );
+
+
+
+// Quick rejection of the points inside the main cardioid, the period 2 bulb and
+// the three small bulbs near them. Same tests of BuddhaGenerator::evaluate().
+static inline bool insideKnownBulbs ( double cr, double ci ) {
+	const double ci2 = ci * ci;
+	if ( (cr+1.0) * (cr+1.0) + ci2 < 0.0625 ) return true;
+
+	double q = (cr-0.25)*(cr-0.25) + ci2;
+	if ( q*(q+(cr-0.25)) < 0.25*ci2 ) return true;
+
+	if ( (cr+1.309)*(cr+1.309) + ci2 < 0.00345 ) return true;
+	if ( (cr+0.125)*(cr+0.125) + (ci-0.744)*(ci-0.744) < 0.0088 ) return true;
+	if ( (cr+0.125)*(cr+0.125) + (ci+0.744)*(ci+0.744) < 0.0088 ) return true;
+	return false;
+}
+
+// the known bulbs and the precomputed interior map. Static like insideInterior().
+static inline bool insideKnownInterior ( const InteriorView& interior, double cr, double ci ) {
+	return insideKnownBulbs( cr, ci ) || insideInterior( interior, cr, ci );
+}
+
+
+// one lane, used when the cpu has nothing better (and as reference for the others). Also
+// the scalar code uses it for the formulas.
+template <class T>
+struct ScalarLane {
+	typedef T scalar;
+	typedef T reg;
+	typedef bool mask;
+	enum { width = 1 };
+
+	static inline reg set1 ( T a ) { return a; }
+	static inline reg load ( const T* p ) { return *p; }
+	static inline void store ( T* p, reg a ) { *p = a; }
+	static inline reg add ( reg a, reg b ) { return a + b; }
+	static inline reg sub ( reg a, reg b ) { return a - b; }
+	static inline reg mul ( reg a, reg b ) { return a * b; }
+	static inline mask lt ( reg a, reg b ) { return a < b; }
+	static inline mask le ( reg a, reg b ) { return a <= b; }
+	static inline mask eq ( reg a, reg b ) { return a == b; }
+	static inline mask andm ( mask a, mask b ) { return a && b; }
+	static inline mask orm ( mask a, mask b ) { return a || b; }
+	static inline mask andnotm ( mask a, mask b ) { return !a && b; }
+	static inline reg select ( mask m, reg a, reg b ) { return m ? a : b; }
+	static inline reg addIf ( reg a, mask m, reg b ) { return m ? a + b : a; }
+	static inline mask fromBits ( unsigned int bits ) { return ( bits & 1 ) != 0; }
+	static inline unsigned int toBits ( mask m ) { return m ? 1 : 0; }
+};
+
+
+// The kernel, written once for every vector type V. V gives the scalar type (scalar), the
+// register type (reg), the mask type (mask), the number of lanes (width) and some basic operations.
+// Every lane has its own iteration counter and periodicity step, so when a lane escapes
+// or is found periodic its result is written and the lane is immediately refilled with
+// the next point. This way the lanes are always busy and we never wait for the slowest
+// orbit of a group (the interior points can take thousands of iterations more).
+// F is the formula and A tells which orbits are kept, see formula.h.
+template <class V, class F, class A>
+inline void evaluateLanesKernel ( const KernelView& v, const double* cr, const double* ci,
+				int n, LaneResult* out ) {
+	typedef typename V::scalar T;
+	const typename V::reg minre = V::set1( (T) v.minre ), maxre = V::set1( (T) v.maxre );
+	const typename V::reg minim = V::set1( (T) v.minim ), maxim = V::set1( (T) v.maxim );
+	const typename V::reg cre = V::set1( (T) v.cre ), cim = V::set1( (T) v.cim );
+	const typename V::reg four = V::set1( 4 ), zero = V::set1( 0 ), one = V::set1( 1 );
+	const typename V::reg epsilon = V::set1( (T) v.periodicityTolerance );
+	const typename V::reg last = V::set1( (T) v.high - 1 );
+
+	// the lanes state, in memory only when a lane has to be refilled
+	enum { RE, IM, ZR, ZI, CRITR, CRITI, DISTANCE, CONTRIBUTE, ITERATION, CRITICALSTEP, STATES };
+	T state[STATES][V::width];
+	int slot[V::width];
+	unsigned int activeBits = 0;
+	int next = 0;
+
+	for ( int k = 0; k < V::width; ++k ) {
+		for ( int s = 0; s < STATES; ++s ) state[s][k] = 0;
+		slot[k] = -1;
+	}
+
+	typename V::reg re, im, zr, zi, critr, criti, distance, contribute, iteration, criticalStep;
+	do {
+		// put new points in the free lanes. The points inside the known interior are
+		// not even loaded, as in evaluate(), when they are not the ones we want
+		for ( int k = 0; k < V::width; ++k ) {
+			if ( activeBits & ( 1u << k ) ) continue;
+			slot[k] = -1;
+			while ( next < n && slot[k] == -1 ) {
+				LaneResult& r = out[next];
+				r.max = -1;
+				r.contribute = 0;
+				r.calculated = 0;
+				r.centerDistance = 64.0;
+				if ( v.high > 0 && !( F::knownInterior && A::escaping &&
+						      insideKnownInterior( v.interior, cr[next], ci[next] ) ) ) {
+					slot[k] = next;
+					state[RE][k] = state[ZR][k] = state[CRITR][k] = (T) cr[next];
+					state[IM][k] = state[ZI][k] = state[CRITI][k] = (T) ci[next];
+					state[DISTANCE][k] = 64;
+					state[CONTRIBUTE][k] = state[ITERATION][k] = 0;
+					state[CRITICALSTEP][k] = (T) v.periodicityStep;
+					activeBits |= 1u << k;
+				}
+				++next;
+			}
+		}
+
+		if ( activeBits == 0 ) break;
+
+		re = V::load( state[RE] ); im = V::load( state[IM] );
+		zr = V::load( state[ZR] ); zi = V::load( state[ZI] );
+		critr = V::load( state[CRITR] ); criti = V::load( state[CRITI] );
+		distance = V::load( state[DISTANCE] ); contribute = V::load( state[CONTRIBUTE] );
+		iteration = V::load( state[ITERATION] ); criticalStep = V::load( state[CRITICALSTEP] );
+		const typename V::mask active = V::fromBits( activeBits );
+
+		unsigned int doneBits = 0, escapedBits = 0, periodicBits = 0;
+		while ( doneBits == 0 ) {
+			const typename V::reg zr2 = V::mul( zr, zr ), zi2 = V::mul( zi, zi );
+			const typename V::reg norm = V::add( zr2, zi2 );
+
+			// inside() for every lane, also the simmetric point counts if the formula is simmetric
+			typename V::mask isInside = V::andm( V::le( zr, maxre ), V::le( minre, zr ) );
+			typename V::mask insideIm = V::andm( V::le( zi, maxim ), V::le( minim, zi ) );
+			if ( F::symmetric ) {
+				const typename V::reg nzi = V::sub( zero, zi );
+				insideIm = V::orm( insideIm, V::andm( V::le( nzi, maxim ), V::le( minim, nzi ) ) );
+			}
+			isInside = V::andm( V::andm( isInside, insideIm ), active );
+			contribute = V::addIf( contribute, isInside, one );
+
+			// the distance from the center, only while the orbit is in the radius 2 disk
+			const typename V::reg dr = V::sub( zr, cre ), di = V::sub( zi, cim );
+			const typename V::reg tmp = V::add( V::mul( dr, dr ), V::mul( di, di ) );
+			const typename V::mask closer = V::andm( V::lt( tmp, distance ), V::lt( norm, four ) );
+			distance = V::select( closer, tmp, distance );
+			distance = V::select( isInside, zero, distance );
+
+			// escaped lanes, as in evaluate() they can continue a little bit if they're in the window
+			const typename V::mask escaped = V::andnotm( isInside, V::andm( active, V::lt( four, norm ) ) );
+
+			// periodicity check, see evaluate(). The critical point is taken when the
+			// iteration reaches the step, and again at twice the step (doubling it)
+			const typename V::mask atStep = V::eq( iteration, criticalStep );
+			const typename V::mask afterStep = V::lt( criticalStep, iteration );
+			const typename V::reg pr = V::sub( zr, critr ), pi = V::sub( zi, criti );
+			const typename V::mask periodic = V::andnotm( escaped, V::andm( V::andm( active, afterStep ),
+					V::lt( V::add( V::mul( pr, pr ), V::mul( pi, pi ) ), epsilon ) ) );
+			const typename V::reg doubleStep = V::add( criticalStep, criticalStep );
+			const typename V::mask doubling = V::andm( afterStep, V::eq( iteration, doubleStep ) );
+			const typename V::mask newCritical = V::orm( atStep, doubling );
+			critr = V::select( newCritical, zr, critr );
+			criti = V::select( newCritical, zi, criti );
+			criticalStep = V::select( doubling, doubleStep, criticalStep );
+
+			// the lanes that reached the iteration limit
+			const typename V::mask limit = V::andm( active, V::eq( iteration, last ) );
+
+			// one test per iteration, the details are read only when something happened
+			doneBits = V::toBits( V::orm( V::orm( escaped, periodic ), limit ) );
+			if ( doneBits ) {
+				escapedBits = V::toBits( escaped );
+				periodicBits = V::toBits( periodic );
+			}
+
+			F::template step<V>( zr, zi, zr2, zi2, re, im );
+			iteration = V::add( iteration, one );
+		}
+
+		V::store( state[ZR], zr ); V::store( state[ZI], zi );
+		V::store( state[CRITR], critr ); V::store( state[CRITI], criti );
+		V::store( state[DISTANCE], distance ); V::store( state[CONTRIBUTE], contribute );
+		V::store( state[ITERATION], iteration ); V::store( state[CRITICALSTEP], criticalStep );
+
+		// the iteration was already incremented, so here it's i + 1
+		for ( int k = 0; k < V::width; ++k ) if ( doneBits & ( 1u << k ) ) {
+			LaneResult& r = out[slot[k]];
+			const unsigned int i = (unsigned int) state[ITERATION][k] - 1;
+			r.contribute = (unsigned int) state[CONTRIBUTE][k];
+			r.centerDistance = state[DISTANCE][k];
+			if ( escapedBits & ( 1u << k ) ) {
+				r.max = A::escaping ? i - 1 : -1;
+				r.calculated = i;
+			} else {
+				// the bounded orbits are drawn up to where they were computed
+				r.max = A::escaping ? -1 : (int) i;
+				r.calculated = ( periodicBits & ( 1u << k ) ) ? i : v.high;
+			}
+			activeBits &= ~( 1u << k );
+		}
+	} while ( activeBits != 0 || next < n );
+}
+
+
+// The projection for a vector type V, that needs also these operations on double lanes:
+// deinterleave (loads width complex numbers and splits the real and imaginary parts, the
+// order of the lanes doesn't matter here) and toIndex (truncates and stores width ints).
+// The few points left at the end are done by the scalar code.
+template <class V>
+inline int projectPointsKernel ( const ProjectView& v, const double* points, int n, unsigned int* pixels ) {
+	const typename V::reg minre = V::set1( v.minre ), maxre = V::set1( v.maxre );
+	const typename V::reg minim = V::set1( v.minim ), maxim = V::set1( v.maxim );
+	const typename V::reg scale = V::set1( v.scale ), zero = V::set1( 0.0 );
+	int x[V::width], y[V::width], conjY[V::width];
+	int count = 0, k = 0;
+
+	for ( ; k + V::width <= n; k += V::width ) {
+		typename V::reg re, im;
+		V::deinterleave( points + 2 * k, re, im );
+		const typename V::reg nim = V::sub( zero, im );
+
+		const typename V::mask inRe = V::andm( V::le( minre, re ), V::le( re, maxre ) );
+		const unsigned int bits = V::toBits( V::andm( inRe, V::andm( V::lt( minim, im ), V::lt( im, maxim ) ) ) );
+		const unsigned int conjBits = v.symmetric ? V::toBits( V::andm( inRe, V::andm( V::lt( minim, nim ), V::lt( nim, maxim ) ) ) ) : 0;
+		if ( ( bits | conjBits ) == 0 ) continue;
+
+		// x and y are truncated like the unsigned int conversions of drawPoint(), the tiles
+		// are made on the integers. The lanes outside of the window give garbage, never used.
+		V::toIndex( x, V::mul( V::sub( re, minre ), scale ) );
+		V::toIndex( y, V::mul( V::sub( maxim, im ), scale ) );
+		V::toIndex( conjY, V::mul( V::sub( maxim, nim ), scale ) );
+
+		// without branches: every offset is written, but the next one overwrites it if
+		// its bit is not set. count is always less than 2n here.
+		for ( int j = 0; j < V::width; ++j ) {
+			pixels[count] = tiledPixel( x[j], y[j], v.tiles );
+			count += ( bits >> j ) & 1;
+		}
+		for ( int j = 0; j < V::width; ++j ) {
+			pixels[count] = tiledPixel( x[j], conjY[j], v.tiles );
+			count += ( conjBits >> j ) & 1;
+		}
+	}
+
+	return count + projectPointsScalar( v, points + 2 * k, n - k, pixels + count );
+}
+
+
+// The kernel in two passes, for the Buddhabrot. The contribute and the distance from the
+// center are needed only for the orbits that escape, the others are thrown away in any case,
+// so the first pass does only the arithmetic: blocks of EVALUATEBLOCK iterations without any
+// test, then the escape (also to infinity or NaN, the block can go past it) and the
+// periodicity are tested on the last point of the block. The periodic point is saved and
+// compared at the ends of the blocks, so the cycles are found a little later than by
+// evaluateLanesKernel(), and calculated is rounded to the block.
+// The lanes that escaped go back to the beginning of their orbit and are computed again by
+// evaluateLanesKernel(), with all the tests, so their results are exactly the same. The two
+// passes must round in the same way, so the kernel files are compiled without contraction of
+// mul and add (-ffp-contract=off with gcc, /fp:precise with MSVC): otherwise a chaotic orbit
+// can escape in one and not in the other, and it's lost. The periodic lanes have calculated rounded to the block,
+// so with Brent the lengths of the cycles are counted in blocks.
+template <class V, class F, class A>
+inline void evaluateLanesBlocked ( const KernelView& v, const double* cr, const double* ci,
+				   int n, LaneResult* out ) {
+	typedef typename V::scalar T;
+	const typename V::reg four = V::set1( 4 ), block = V::set1( EVALUATEBLOCK );
+	const typename V::reg epsilon = V::set1( (T) v.periodicityTolerance );
+	const typename V::reg high = V::set1( (T) v.high );
+	// the periodic point is saved only at the end of a block
+	const unsigned int firstStep = ( v.periodicityStep + EVALUATEBLOCK - 1 ) / EVALUATEBLOCK * EVALUATEBLOCK;
+
+	enum { RE, IM, ZR, ZI, CRITR, CRITI, ITERATION, CRITICALSTEP, STATES };
+	T state[STATES][V::width];
+	int slot[V::width];
+	unsigned int activeBits = 0;
+	int next = 0;
+
+	// the escaping points, computed again in groups
+	enum { AGAIN = 64 };
+	double againRe[AGAIN], againIm[AGAIN];
+	LaneResult againOut[AGAIN];
+	int againSlot[AGAIN];
+	int again = 0;
+
+	for ( int k = 0; k < V::width; ++k ) {
+		for ( int s = 0; s < STATES; ++s ) state[s][k] = 0;
+		slot[k] = -1;
+	}
+
+	typename V::reg re, im, zr, zi, critr, criti, iteration, criticalStep;
+	do {
+		// the same filling of evaluateLanesKernel()
+		for ( int k = 0; k < V::width; ++k ) {
+			if ( activeBits & ( 1u << k ) ) continue;
+			slot[k] = -1;
+			while ( next < n && slot[k] == -1 ) {
+				LaneResult& r = out[next];
+				r.max = -1;
+				r.contribute = 0;
+				r.calculated = 0;
+				r.centerDistance = 64.0;
+				if ( v.high > 0 && !( F::knownInterior && insideKnownInterior( v.interior, cr[next], ci[next] ) ) ) {
+					slot[k] = next;
+					state[RE][k] = state[ZR][k] = state[CRITR][k] = (T) cr[next];
+					state[IM][k] = state[ZI][k] = state[CRITI][k] = (T) ci[next];
+					state[ITERATION][k] = 0;
+					state[CRITICALSTEP][k] = (T) firstStep;
+					activeBits |= 1u << k;
+				}
+				++next;
+			}
+		}
+
+		if ( activeBits == 0 ) break;
+
+		re = V::load( state[RE] ); im = V::load( state[IM] );
+		zr = V::load( state[ZR] ); zi = V::load( state[ZI] );
+		critr = V::load( state[CRITR] ); criti = V::load( state[CRITI] );
+		iteration = V::load( state[ITERATION] ); criticalStep = V::load( state[CRITICALSTEP] );
+		const typename V::mask active = V::fromBits( activeBits );
+
+		unsigned int doneBits = 0, escapedBits = 0, periodicBits = 0;
+		while ( doneBits == 0 ) {
+			for ( int j = 0; j < EVALUATEBLOCK; ++j )
+				F::template step<V>( zr, zi, V::mul( zr, zr ), V::mul( zi, zi ), re, im );
+			iteration = V::add( iteration, block );
+
+			// not norm <= 4, that is true also for NaN
+			const typename V::reg norm = V::add( V::mul( zr, zr ), V::mul( zi, zi ) );
+			const typename V::mask escaped = V::andnotm( V::le( norm, four ), active );
+
+			// the same doubling of evaluateLanesKernel(), on the ends of the blocks
+			const typename V::mask atStep = V::eq( iteration, criticalStep );
+			const typename V::mask afterStep = V::lt( criticalStep, iteration );
+			const typename V::reg pr = V::sub( zr, critr ), pi = V::sub( zi, criti );
+			const typename V::mask periodic = V::andnotm( escaped, V::andm( V::andm( active, afterStep ),
+					V::lt( V::add( V::mul( pr, pr ), V::mul( pi, pi ) ), epsilon ) ) );
+			const typename V::reg doubleStep = V::add( criticalStep, criticalStep );
+			const typename V::mask doubling = V::andm( afterStep, V::eq( iteration, doubleStep ) );
+			const typename V::mask newCritical = V::orm( atStep, doubling );
+			critr = V::select( newCritical, zr, critr );
+			criti = V::select( newCritical, zi, criti );
+			criticalStep = V::select( doubling, doubleStep, criticalStep );
+
+			// an orbit that escapes after high is found by the second pass
+			const typename V::mask limit = V::andm( active, V::le( high, iteration ) );
+
+			doneBits = V::toBits( V::orm( V::orm( escaped, periodic ), limit ) );
+			if ( doneBits ) {
+				escapedBits = V::toBits( escaped );
+				periodicBits = V::toBits( periodic );
+			}
+		}
+
+		V::store( state[ZR], zr ); V::store( state[ZI], zi );
+		V::store( state[CRITR], critr ); V::store( state[CRITI], criti );
+		V::store( state[ITERATION], iteration ); V::store( state[CRITICALSTEP], criticalStep );
+
+		for ( int k = 0; k < V::width; ++k ) if ( doneBits & ( 1u << k ) ) {
+			activeBits &= ~( 1u << k );
+			if ( !( escapedBits & ( 1u << k ) ) ) {
+				out[slot[k]].calculated = ( periodicBits & ( 1u << k ) ) ? (unsigned int) state[ITERATION][k] : v.high;
+				continue;
+			}
+			againRe[again] = cr[slot[k]];
+			againIm[again] = ci[slot[k]];
+			againSlot[again] = slot[k];
+			if ( ++again < AGAIN ) continue;
+			evaluateLanesKernel<V, F, A>( v, againRe, againIm, again, againOut );
+			for ( int j = 0; j < again; ++j ) out[againSlot[j]] = againOut[j];
+			again = 0;
+		}
+	} while ( activeBits != 0 || next < n );
+
+	evaluateLanesKernel<V, F, A>( v, againRe, againIm, again, againOut );
+	for ( int j = 0; j < again; ++j ) out[againSlot[j]] = againOut[j];
+}
+
+
+template <class V, class F, class A>
+void evaluateLanesInstance ( const KernelView& v, const double* cr, const double* ci, int n, LaneResult* out ) {
+	// the bounded orbits are the ones drawn in the anti-Buddhabrot, they need all the tests
+	if ( EVALUATEBLOCK > 1 && A::escaping ) evaluateLanesBlocked<V, F, A>( v, cr, ci, n, out );
+	else evaluateLanesKernel<V, F, A>( v, cr, ci, n, out );
+}
+
+#endif
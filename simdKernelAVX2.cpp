@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2010, Emilio Del Tessandoro
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY EMILIO DEL TESSANDORO o ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL EMILIO DEL TESSANDORO BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+
+// With gcc this file must be compiled with -mavx2 -mfma, MSVC accepts the intrinsics
+// anyway. It is called only if selectEvaluateLanes() found the AVX2 instruction set.
+
+#include "simdKernel.h"
+#include "doubleDouble.h"
+#include <immintrin.h>
+
+
+struct AVX2Lanes {
+	typedef double scalar;
+	typedef __m256d reg;
+	typedef __m256d mask;
+	enum { width = 4 };
+
+	static inline reg set1 ( double a ) { return _mm256_set1_pd( a ); }
+	static inline reg load ( const double* p ) { return _mm256_loadu_pd( p ); }
+	static inline void store ( double* p, reg a ) { _mm256_storeu_pd( p, a ); }
+	static inline reg add ( reg a, reg b ) { return _mm256_add_pd( a, b ); }
+	static inline reg sub ( reg a, reg b ) { return _mm256_sub_pd( a, b ); }
+	static inline reg mul ( reg a, reg b ) { return _mm256_mul_pd( a, b ); }
+	static inline mask lt ( reg a, reg b ) { return _mm256_cmp_pd( a, b, _CMP_LT_OQ ); }
+	static inline mask le ( reg a, reg b ) { return _mm256_cmp_pd( a, b, _CMP_LE_OQ ); }
+	static inline mask eq ( reg a, reg b ) { return _mm256_cmp_pd( a, b, _CMP_EQ_OQ ); }
+	static inline mask andm ( mask a, mask b ) { return _mm256_and_pd( a, b ); }
+	static inline mask orm ( mask a, mask b ) { return _mm256_or_pd( a, b ); }
+	static inline mask andnotm ( mask a, mask b ) { return _mm256_andnot_pd( a, b ); }
+	static inline reg select ( mask m, reg a, reg b ) { return _mm256_blendv_pd( b, a, m ); }
+	static inline reg addIf ( reg a, mask m, reg b ) { return _mm256_add_pd( a, _mm256_and_pd( m, b ) ); }
+	static inline mask fromBits ( unsigned int bits ) {
+		const int a = ( bits & 8 ) ? -1 : 0, b = ( bits & 4 ) ? -1 : 0, c = ( bits & 2 ) ? -1 : 0, d = ( bits & 1 ) ? -1 : 0;
+		return _mm256_castsi256_pd( _mm256_set_epi32( a, a, b, b, c, c, d, d ) );
+	}
+	static inline unsigned int toBits ( mask m ) { return _mm256_movemask_pd( m ); }
+
+	// for the projection, the lanes are 0 2 1 3
+	static inline void deinterleave ( const double* p, reg& re, reg& im ) {
+		const __m256d a = _mm256_loadu_pd( p ), b = _mm256_loadu_pd( p + 4 );
+		re = _mm256_unpacklo_pd( a, b );
+		im = _mm256_unpackhi_pd( a, b );
+	}
+	static inline void toIndex ( int* p, reg a ) { _mm_storeu_si128( (__m128i*) p, _mm256_cvttpd_epi32( a ) ); }
+};
+
+struct AVX2FloatLanes {
+	typedef float scalar;
+	typedef __m256 reg;
+	typedef __m256 mask;
+	enum { width = 8 };
+
+	static inline reg set1 ( float a ) { return _mm256_set1_ps( a ); }
+	static inline reg load ( const float* p ) { return _mm256_loadu_ps( p ); }
+	static inline void store ( float* p, reg a ) { _mm256_storeu_ps( p, a ); }
+	static inline reg add ( reg a, reg b ) { return _mm256_add_ps( a, b ); }
+	static inline reg sub ( reg a, reg b ) { return _mm256_sub_ps( a, b ); }
+	static inline reg mul ( reg a, reg b ) { return _mm256_mul_ps( a, b ); }
+	static inline mask lt ( reg a, reg b ) { return _mm256_cmp_ps( a, b, _CMP_LT_OQ ); }
+	static inline mask le ( reg a, reg b ) { return _mm256_cmp_ps( a, b, _CMP_LE_OQ ); }
+	static inline mask eq ( reg a, reg b ) { return _mm256_cmp_ps( a, b, _CMP_EQ_OQ ); }
+	static inline mask andm ( mask a, mask b ) { return _mm256_and_ps( a, b ); }
+	static inline mask orm ( mask a, mask b ) { return _mm256_or_ps( a, b ); }
+	static inline mask andnotm ( mask a, mask b ) { return _mm256_andnot_ps( a, b ); }
+	static inline reg select ( mask m, reg a, reg b ) { return _mm256_blendv_ps( b, a, m ); }
+	static inline reg addIf ( reg a, mask m, reg b ) { return _mm256_add_ps( a, _mm256_and_ps( m, b ) ); }
+	static inline mask fromBits ( unsigned int bits ) {
+		const __m256i bit = _mm256_set_epi32( 128, 64, 32, 16, 8, 4, 2, 1 );
+		const __m256i set = _mm256_and_si256( _mm256_set1_epi32( bits ), bit );
+		return _mm256_castsi256_ps( _mm256_cmpeq_epi32( set, bit ) );
+	}
+	static inline unsigned int toBits ( mask m ) { return _mm256_movemask_ps( m ); }
+};
+
+
+EvaluateLanesFunction selectLanesAVX2 ( Formula formula, bool bounded, bool singlePrecision ) {
+	return singlePrecision ? lanesFor<AVX2FloatLanes>( formula, bounded ) : lanesFor<AVX2Lanes>( formula, bounded );
+}
+
+EvaluateDeepFunction selectDeepLanesAVX2 ( bool bounded ) {
+	return deepLanesFor<AVX2Lanes>( bounded );
+}
+
+int projectPointsAVX2 ( const ProjectView& v, const double* points, int n, unsigned int* pixels ) {
+	return projectPointsKernel<AVX2Lanes>( v, points, n, pixels );
+}
+
+unsigned short planeMaximumAVX2 ( const unsigned short* plane, unsigned int n ) {
+	__m256i m0 = _mm256_setzero_si256( ), m1 = m0, m2 = m0, m3 = m0;
+	unsigned int i = 0;
+	for ( ; i + 64 <= n; i += 64 ) {
+		m0 = _mm256_max_epu16( m0, _mm256_load_si256( (const __m256i*) ( plane + i ) ) );
+		m1 = _mm256_max_epu16( m1, _mm256_load_si256( (const __m256i*) ( plane + i + 16 ) ) );
+		m2 = _mm256_max_epu16( m2, _mm256_load_si256( (const __m256i*) ( plane + i + 32 ) ) );
+		m3 = _mm256_max_epu16( m3, _mm256_load_si256( (const __m256i*) ( plane + i + 48 ) ) );
+	}
+
+	unsigned short lanes[16];
+	_mm256_storeu_si256( (__m256i*) lanes, _mm256_max_epu16( _mm256_max_epu16( m0, m1 ), _mm256_max_epu16( m2, m3 ) ) );
+	// not std::max(), that would be a copy compiled for AVX2 shared with the rest of the program
+	unsigned short m = 0;
+	for ( int k = 0; k < 16; ++k ) m = lanes[k] > m ? lanes[k] : m;
+	for ( ; i < n; ++i ) m = plane[i] > m ? plane[i] : m;
+	return m;
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2010, Emilio Del Tessandoro
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY EMILIO DEL TESSANDORO o ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL EMILIO DEL TESSANDORO BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+
+// With gcc this file must be compiled with -mavx512f, MSVC accepts the intrinsics
+// anyway. It is called only if selectEvaluateLanes() found the AVX-512F instruction set.
+
+#include "simdKernel.h"
+#include "doubleDouble.h"
+#include <immintrin.h>
+
+
+// here the masks are real mask registers, so no blend or and tricks are needed
+struct AVX512Lanes {
+	typedef double scalar;
+	typedef __m512d reg;
+	typedef __mmask8 mask;
+	enum { width = 8 };
+
+	static inline reg set1 ( double a ) { return _mm512_set1_pd( a ); }
+	static inline reg load ( const double* p ) { return _mm512_loadu_pd( p ); }
+	static inline void store ( double* p, reg a ) { _mm512_storeu_pd( p, a ); }
+	static inline reg add ( reg a, reg b ) { return _mm512_add_pd( a, b ); }
+	static inline reg sub ( reg a, reg b ) { return _mm512_sub_pd( a, b ); }
+	static inline reg mul ( reg a, reg b ) { return _mm512_mul_pd( a, b ); }
+	static inline mask lt ( reg a, reg b ) { return _mm512_cmp_pd_mask( a, b, _CMP_LT_OQ ); }
+	static inline mask le ( reg a, reg b ) { return _mm512_cmp_pd_mask( a, b, _CMP_LE_OQ ); }
+	static inline mask eq ( reg a, reg b ) { return _mm512_cmp_pd_mask( a, b, _CMP_EQ_OQ ); }
+	static inline mask andm ( mask a, mask b ) { return a & b; }
+	static inline mask orm ( mask a, mask b ) { return a | b; }
+	static inline mask andnotm ( mask a, mask b ) { return (mask) ( ~a & b ); }
+	static inline reg select ( mask m, reg a, reg b ) { return _mm512_mask_blend_pd( m, b, a ); }
+	static inline reg addIf ( reg a, mask m, reg b ) { return _mm512_mask_add_pd( a, m, a, b ); }
+	static inline mask fromBits ( unsigned int bits ) { return (mask) bits; }
+	static inline unsigned int toBits ( mask m ) { return m; }
+
+	// for the projection, the lanes are 0 2 1 3 4 6 5 7
+	static inline void deinterleave ( const double* p, reg& re, reg& im ) {
+		const __m512d a = _mm512_loadu_pd( p ), b = _mm512_loadu_pd( p + 8 );
+		re = _mm512_unpacklo_pd( a, b );
+		im = _mm512_unpackhi_pd( a, b );
+	}
+	static inline void toIndex ( int* p, reg a ) { _mm256_storeu_si256( (__m256i*) p, _mm512_cvttpd_epi32( a ) ); }
+};
+
+struct AVX512FloatLanes {
+	typedef float scalar;
+	typedef __m512 reg;
+	typedef __mmask16 mask;
+	enum { width = 16 };
+
+	static inline reg set1 ( float a ) { return _mm512_set1_ps( a ); }
+	static inline reg load ( const float* p ) { return _mm512_loadu_ps( p ); }
+	static inline void store ( float* p, reg a ) { _mm512_storeu_ps( p, a ); }
+	static inline reg add ( reg a, reg b ) { return _mm512_add_ps( a, b ); }
+	static inline reg sub ( reg a, reg b ) { return _mm512_sub_ps( a, b ); }
+	static inline reg mul ( reg a, reg b ) { return _mm512_mul_ps( a, b ); }
+	static inline mask lt ( reg a, reg b ) { return _mm512_cmp_ps_mask( a, b, _CMP_LT_OQ ); }
+	static inline mask le ( reg a, reg b ) { return _mm512_cmp_ps_mask( a, b, _CMP_LE_OQ ); }
+	static inline mask eq ( reg a, reg b ) { return _mm512_cmp_ps_mask( a, b, _CMP_EQ_OQ ); }
+	static inline mask andm ( mask a, mask b ) { return a & b; }
+	static inline mask orm ( mask a, mask b ) { return a | b; }
+	static inline mask andnotm ( mask a, mask b ) { return (mask) ( ~a & b ); }
+	static inline reg select ( mask m, reg a, reg b ) { return _mm512_mask_blend_ps( m, b, a ); }
+	static inline reg addIf ( reg a, mask m, reg b ) { return _mm512_mask_add_ps( a, m, a, b ); }
+	static inline mask fromBits ( unsigned int bits ) { return (mask) bits; }
+	static inline unsigned int toBits ( mask m ) { return m; }
+};
+
+
+EvaluateLanesFunction selectLanesAVX512 ( Formula formula, bool bounded, bool singlePrecision ) {
+	return singlePrecision ? lanesFor<AVX512FloatLanes>( formula, bounded ) : lanesFor<AVX512Lanes>( formula, bounded );
+}
+
+EvaluateDeepFunction selectDeepLanesAVX512 ( bool bounded ) {
+	return deepLanesFor<AVX512Lanes>( bounded );
+}
+
+int projectPointsAVX512 ( const ProjectView& v, const double* points, int n, unsigned int* pixels ) {
+	return projectPointsKernel<AVX512Lanes>( v, points, n, pixels );
+}
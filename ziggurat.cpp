@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2010, Emilio Del Tessandoro
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY EMILIO DEL TESSANDORO o ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL EMILIO DEL TESSANDORO BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+
+
+#include "ziggurat.h"
+#include <cmath>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+
+Ziggurat::Ziggurat ( double (*density)( double ), double (*inverse)( double ), double (*tail)( double ) ) {
+	// the first strip is at r, bigger if the strips are too wide and reach the top of the
+	// density before the last one. I search it on a logarithmic scale, the tails can be long.
+	double lo = 1.0e-3, hi = 1.0e6;
+	for ( int i = 0; i < 200; ++i ) {
+		const double r = sqrt( lo * hi );
+		if ( overflows( r, density, inverse, tail ) ) lo = r;
+		else hi = r;
+	}
+
+	const double r = hi;
+	const double area = r * density( r ) + tail( r );
+	x[0] = area / density( r );
+	f[0] = 0.0;
+	x[1] = r;
+	f[1] = density( r );
+	for ( int i = 1; i < ZIGGURAT_LAYERS - 1; ++i ) {
+		f[i + 1] = f[i] + area / x[i];
+		x[i + 1] = inverse( f[i + 1] );
+	}
+	x[ZIGGURAT_LAYERS] = 0.0;
+	f[ZIGGURAT_LAYERS] = density( 0.0 );
+}
+
+bool Ziggurat::overflows ( double r, double (*density)( double ), double (*inverse)( double ), double (*tail)( double ) ) {
+	const double top = density( 0.0 );
+	const double area = r * density( r ) + tail( r );
+	double width = r, height = density( r );
+	for ( int i = 1; i < ZIGGURAT_LAYERS; ++i ) {
+		height += area / width;
+		if ( height >= top ) return true;
+		width = inverse( height );
+	}
+	return false;
+}
+
+
+double gaussianDensity ( double x ) {
+	return exp( -0.5 * x * x );
+}
+
+static double gaussianInverse ( double y ) {
+	return sqrt( -2.0 * log( y ) );
+}
+
+static double gaussianTail ( double r ) {
+	return sqrt( M_PI / 2.0 ) * erfc( r / sqrt( 2.0 ) );
+}
+
+
+// t / 2 is the Lambert W of r / 2: Winitzki's approximation and then the Halley's method,
+// two steps are enough almost always
+double radialExponent ( double r ) {
+	const double z = 0.5 * r;
+	const double l = log1p( z );
+	double w = l * ( 1.0 - log1p( l ) / ( 2.0 + l ) );
+	for ( int i = 0; i < 8; ++i ) {
+		const double e = exp( w );
+		const double f = w * e - z;
+		const double step = f / ( e * ( w + 1.0 ) - ( w + 2.0 ) * f / ( 2.0 * w + 2.0 ) );
+		w -= step;
+		if ( fabs( step ) <= 1.0e-15 * w ) break;
+	}
+	return 2.0 * w;
+}
+
+// the derivative of s with r
+double radialDensity ( double r ) {
+	const double t = radialExponent( r );
+	return exp( -1.5 * t ) / ( 1.0 + 0.5 * t );
+}
+
+// the density is decreasing with t, bisection is enough for the tables
+static double radialInverse ( double y ) {
+	double lo = 0.0, hi = 1000.0;
+	for ( int i = 0; i < 200; ++i ) {
+		const double t = 0.5 * ( lo + hi );
+		if ( exp( -1.5 * t ) / ( 1.0 + 0.5 * t ) > y ) lo = t;
+		else hi = t;
+	}
+	const double t = 0.5 * ( lo + hi );
+	return t * exp( 0.5 * t );
+}
+
+// the probability that the radius is after r is the one that s is before exp( -t )
+static double radialTail ( double r ) {
+	return exp( -radialExponent( r ) );
+}
+
+
+const Ziggurat gaussianZiggurat( gaussianDensity, gaussianInverse, gaussianTail );
+const Ziggurat radialZiggurat( radialDensity, radialInverse, radialTail );
+const double radialTailExponent = radialExponent( radialZiggurat.x[1] );
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2010, Emilio Del Tessandoro
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY EMILIO DEL TESSANDORO o ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL EMILIO DEL TESSANDORO BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+
+
+#ifndef ZIGGURAT_H
+#define ZIGGURAT_H
+
+// the strips of the ziggurats, taken from the low ZIGGURAT_BITS bits of a number. The radius
+// of Random::exponential() has a long tail and its density is costly, with 256 strips 3.4% of
+// the points need it, with 1024 less than 1%. Not more than 10 bits, see Random::ziggurat().
+#define ZIGGURAT_BITS		10
+#define ZIGGURAT_LAYERS		( 1 << ZIGGURAT_BITS )
+
+
+// The tables of a ziggurat (Marsaglia and Tsang) for a decreasing density on [0,inf). The area
+// under the density is covered by ZIGGURAT_LAYERS strips of the same area: x[i] is the width
+// of the strip i, that goes from f[i] to f[i + 1] in height, with f[i] = density( x[i] ).
+// The strip 0 is the base with the tail, x[0] is so wide to have the area of the others.
+// A point taken uniformly in a strip is most of the times under the density without computing
+// it, see Random::gaussian() and Random::exponential().
+struct Ziggurat {
+	double x[ZIGGURAT_LAYERS + 1], f[ZIGGURAT_LAYERS + 1];
+
+	// density and its inverse, tail is the area of density after r
+	Ziggurat ( double (*density)( double ), double (*inverse)( double ), double (*tail)( double ) );
+
+private:
+	bool overflows ( double r, double (*density)( double ), double (*inverse)( double ), double (*tail)( double ) );
+};
+
+
+// exp( -x^2 / 2 ), the gaussian without normalization
+double gaussianDensity ( double x );
+
+// The radius of Random::exponential() is r = -log( s ) / sqrt( s ) with s uniform in (0,1],
+// so with t = -log( s ) it's r = t * exp( t / 2 ), t exponentially distributed. This gives
+// back t for a radius r.
+double radialExponent ( double r );
+double radialDensity ( double r );
+// the exponent of the first strip, where the tail starts
+extern const double radialTailExponent;
+
+extern const Ziggurat gaussianZiggurat;
+extern const Ziggurat radialZiggurat;
+
+
+#endif // ZIGGURAT_H